@@ -0,0 +1,55 @@
+#ifndef RUNTIME_ARENA_HPP
+#define RUNTIME_ARENA_HPP
+
+#include <stddef.h>
+#include <vector>
+
+/**
+ * @brief A bump-pointer arena for the scratch buffers of one request at a time, freed all at once by a reset.
+ * When a request needs more than the arena holds, the extra buffers come from tensor_alloc, and the next reset grows
+ * the arena to the most used, so that it only grows when a larger shape appears.
+ */
+typedef struct scratch_arena {
+    char *base;
+    size_t capacity;
+    size_t used;
+    // bytes asked since the last reset, including the overflow buffers
+    size_t requested;
+    std::vector<void *> overflow;
+} scratch_arena;
+
+/**
+ * @brief Initialize an arena.
+ *
+ * @param arena The arena.
+ * @param capacity The initial capacity in bytes, e.g. the scratch buffers of the largest request the model expects.
+ *
+ * @return 0 if the arena is allocated, and non-zero otherwise.
+ */
+int arena_init(scratch_arena *arena, size_t capacity);
+
+/**
+ * @brief Take a buffer from an arena, aligned on TENSOR_ALIGNMENT bytes. The arena must be used by one thread at a time.
+ *
+ * @param arena The arena.
+ * @param size The size of the buffer in bytes.
+ *
+ * @return The buffer, valid until the next reset, or NULL if the memory is exhausted.
+ */
+void *arena_alloc(scratch_arena *arena, size_t size);
+
+/**
+ * @brief Free every buffer of an arena at once, and grow it if the last requests did not fit.
+ *
+ * @param arena The arena.
+ */
+void arena_reset(scratch_arena *arena);
+
+/**
+ * @brief Free the memory of an arena.
+ *
+ * @param arena The arena.
+ */
+void arena_free(scratch_arena *arena);
+
+#endif
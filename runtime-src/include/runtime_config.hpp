@@ -0,0 +1,109 @@
+#ifndef RUNTIME_CONFIG_HPP
+#define RUNTIME_CONFIG_HPP
+
+#include <stddef.h>
+#include <sched.h>
+
+#define RUNTIME_PATH_LENGTH 256
+
+// Worker counts of the accelerator, 0 keeps the vendor default
+typedef struct device_settings {
+    // MxAccl input and output workers
+    int input_workers;
+    int output_workers;
+} device_settings;
+
+typedef struct runtime_config {
+    // number of synthetic inferences run at model loading (0 disables the warm-up)
+    int warmup_iterations;
+    // skip the weights download when the device already holds them, refused until the driver can report them
+    int keep_weights_resident;
+    // time per frame of a simulated accelerator, which reads the ports from the DFP and outputs zeros (0 for the device,
+    // only available with the SIMULATED_DEVICE build option)
+    int simulated_device_us;
+    // coalesce the requests of concurrent callers before sending them to the accelerator
+    int dynamic_batching;
+    int max_batch_size;
+    int max_queue_delay_us;
+    // frames the batcher keeps sent to the accelerator and not received yet (0 for 2 batches)
+    int max_in_flight;
+    // number of requests allowed to wait for the accelerator (0 for no limit)
+    int max_queue_depth;
+    // low-latency mode: busy-poll the completions for that long before sleeping (0 sleeps right away)
+    int spin_us;
+    // SCHED_FIFO priority of the send and receive threads of the batcher (0 keeps the default policy)
+    int realtime_priority;
+    // CPUs of the send and receive threads of the batcher (empty for any)
+    cpu_set_t scheduler_cpus;
+    // CPUs of the MxAccl input and output workers (empty for any)
+    cpu_set_t accl_cpus;
+    // CPUs of the conversion workers, and of the calling threads with pin_callers (empty for any)
+    cpu_set_t conversion_cpus;
+    // pin the threads calling the runtime to the CPUs above for good, otherwise they are left where they are
+    int pin_callers;
+    // worker threads sharing the conversions of each call with its calling thread, on the CPUs above (0 for none)
+    int conversion_threads;
+    // instruction set of the conversion kernels, a conversion_isa (CONVERSION_ISA_AUTO for the best the CPU supports)
+    int conversion_isa;
+    // move the conversions of the callers to their own pipeline stages (dynamic batching only)
+    int pipeline;
+    // one CPU per pipeline stage: input conversion, send, receive, output conversion (empty for the sets above)
+    cpu_set_t pipeline_cpus;
+    // output sets held for runtime_inference_execution_view, until the caller releases them
+    int result_slots;
+    // backing of the large tensor buffers, a huge_page_mode
+    int huge_pages;
+    // NUMA node of the buffers, and default node of the CPU sets above (-1 for none)
+    int numa_node;
+    // applied before the accelerator is started
+    device_settings device;
+    // search the device settings and the batching at model loading, unless the cache has them
+    int autotune;
+    // p99 latency a tuned setting must stay under (0 for no limit)
+    int autotune_latency_budget_us;
+    // synthetic inferences per tried setting
+    int autotune_iterations;
+    char autotune_cache[RUNTIME_PATH_LENGTH];
+    // adjust the number of frames the batcher keeps in flight to the load, every adaptive_interval_ms
+    int adaptive;
+    int adaptive_interval_ms;
+    // upper bound of the frames in flight (0 for 4 batches)
+    int adaptive_max_in_flight;
+} runtime_config;
+
+/**
+ * @brief Get a runtime_config structure with all fields set to their default values.
+ *
+ * @return The default runtime_config structure.
+ */
+runtime_config default_runtime_config();
+
+/**
+ * @brief Apply a single argument passed to `runtime_initialization_with_args` to the configuration.
+ * The value is expected to be a null-terminated string, e.g. {"warmup_iterations", "10"}.
+ *
+ * @param config The runtime_config structure to update.
+ * @param key The key of the argument.
+ * @param value The value of the argument.
+ *
+ * @return 0 if the argument is applied, 1 if the value is invalid, and -1 if the key is unknown.
+ */
+int parse_runtime_argument(runtime_config *config, const char *key, const char *value);
+
+/**
+ * @brief Fill the CPU sets left empty with the CPUs of `numa_node`, when one is given.
+ *
+ * @param config The runtime_config structure to update.
+ *
+ * @return 0 if the placement is valid, and non-zero otherwise.
+ */
+int resolve_runtime_placement(runtime_config *config);
+
+/**
+ * @brief Print the runtime_config structure.
+ *
+ * @param config The runtime_config structure to print.
+ */
+void print_runtime_config(runtime_config *config);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RUNTIME_CONTROLLER_HPP
+#define RUNTIME_CONTROLLER_HPP
+
+#include "runtime_config.hpp"
+#include "runtime_stats.hpp"
+
+/**
+ * @brief Start the adaptive controller, when `adaptive` is set. It needs `dynamic_batching`, and the host-side queue
+ * must be started.
+ * Every `adaptive_interval_ms`, a background thread reads the queue depth, the queue wait and device times recorded
+ * by the stage instrumentation, and the CPU usage of the process over the last period, busy-polling excluded. It
+ * raises the number of frames the batcher keeps in flight while requests wait on the host behind a full pipeline and
+ * CPU time is left, and lowers it when the CPUs are busy, or when nothing waits and the frames only queue inside the
+ * accelerator. With `conversion_threads`, it also lets one more conversion worker take tasks while requests wait and
+ * the conversions of a frame take longer than the accelerator, and parks one when the CPUs are busy, before lowering
+ * the frames in flight. A signal must hold for several periods before the controller acts, and a raise that does not
+ * bring more throughput is undone and not retried for a while. Every change is recorded in the stats.
+ *
+ * @param config The runtime configuration.
+ * @param stats The runtime_stats structure the controller reads, and where its decisions are recorded.
+ *
+ * @return 0 if the controller is started or not enabled, and non-zero otherwise.
+ */
+int controller_start(runtime_config *config, runtime_stats *stats);
+
+/**
+ * @brief Stop the adaptive controller. The number of frames in flight and of conversion workers are left as they are.
+ */
+void controller_stop();
+
+#endif
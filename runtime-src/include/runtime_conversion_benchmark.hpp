@@ -0,0 +1,15 @@
+#ifndef RUNTIME_CONVERSION_BENCHMARK_HPP
+#define RUNTIME_CONVERSION_BENCHMARK_HPP
+
+/**
+ * @brief Measure the kernels specialized for a number of channels against the generic permutation, on the input and
+ * output conversions of feature maps of the usual numbers of channels, and print them. The directions without a
+ * specialized kernel are only measured with the generic one. The kernels of every instruction set the CPU supports
+ * are measured in turn, then the ones chosen before are restored.
+ * The conversions run on the calling thread only, so that the kernels are compared rather than the workers.
+ *
+ * @param iterations The number of frames per measure.
+ */
+void run_conversion_benchmark(int iterations);
+
+#endif
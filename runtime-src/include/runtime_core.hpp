@@ -33,6 +33,50 @@ typedef struct tensors_struct {
     void** data;                        // Data of the tensors
 } tensors_struct;
 
+typedef enum inference_priority {
+    INFERENCE_PRIORITY_HIGH = 0,        // Served before any queued request of a lower class
+    INFERENCE_PRIORITY_NORMAL = 1,      // Default class of runtime_inference_execution
+    INFERENCE_PRIORITY_LOW = 2          // Best-effort requests
+} inference_priority;
+
+#define NUM_INFERENCE_PRIORITIES 3
+
+typedef struct inference_options {
+    inference_priority priority;        // Priority class of the request
+    double deadline_us;                 // Time budget from the call to the outputs in microseconds, 0 for no deadline
+    double timeout_us;                  // Time budget from the call to the send to the accelerator in microseconds, 0 to wait forever. It only bounds the queueing: once sent, the outputs are waited for as long as the accelerator takes
+    int try_submit;                     // Non-zero to fail right away instead of waiting for room in a full queue
+    unsigned long long tag;             // Caller-chosen tag to cancel the request with runtime_inference_cancel, 0 for none
+} inference_options;
+
+typedef struct tensor_layout {
+    const char *name;                   // Name of the tensor
+    tensor_data_type data_type;         // Data type of the elements
+    size_t rank;                        // Rank of the tensor
+    const size_t *shape;                // Shape of the tensor, e.g. NCHW for images
+    size_t size;                        // Size in bytes of a buffer holding the tensor, dense with the last dimension contiguous
+} tensor_layout;
+
+typedef struct result_view {
+    const tensors_struct *outputs;      // Outputs of the inference, read-only and valid until the view is released
+    int slot;                           // Result slot holding the outputs
+    unsigned generation;                // Use of the slot, so that a view released twice cannot release a later one
+} result_view;
+
+// Exit codes of the functions below returning an int, other than runtime_inference_cancel
+typedef enum runtime_status {
+    RUNTIME_STATUS_OK = 0,                  // Success
+    RUNTIME_STATUS_ERROR = 1,               // Failure detailed on the standard output, e.g. invalid argument list, model that cannot be loaded, tensor that cannot be converted
+    RUNTIME_STATUS_DEVICE_ERROR = 2,        // The accelerator failed to take the frame or to return its outputs
+    RUNTIME_STATUS_INVALID_ARGUMENT = 3,    // Inputs, output buffers, options or view not matching the loaded model or the API
+    RUNTIME_STATUS_NOT_READY = 4,           // No model is loaded, or the runtime is being destroyed
+    RUNTIME_STATUS_DEADLINE_MISSED = 5,     // The request is shed because it cannot finish before its deadline
+    RUNTIME_STATUS_QUEUE_FULL = 6,          // The request is refused because the queue is full
+    RUNTIME_STATUS_TIMEOUT = 7,             // The request is not sent to the accelerator before its timeout
+    RUNTIME_STATUS_CANCELLED = 8,           // The queued request is cancelled
+    RUNTIME_STATUS_NO_RESULT_SLOT = 9       // Every result slot of runtime_inference_execution_view is held by the caller
+} runtime_status;
+
 
 /**
  * @brief This function is called to initialize the runtime environment with arguments.
@@ -40,14 +84,14 @@ typedef struct tensors_struct {
  * @param length The number of arguments.
  * @param keys The keys of the arguments.
  * @param values The values of the arguments.
- * @return 0 if the initialization is successful, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK if the initialization is successful, and RUNTIME_STATUS_ERROR otherwise.
 */
 int runtime_initialization_with_args(int length, const char **keys, const void **values);
 
 /**
  * @brief This function is called only once to initialize the runtime environment.
  *
- * @return 0 if the initialization is successful, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK if the initialization is successful, and RUNTIME_STATUS_ERROR otherwise.
  */
 int runtime_initialization();
 
@@ -55,7 +99,7 @@ int runtime_initialization();
  * @brief This function is called to load the model from the file path.
  *
  * @param file_path The path to the model file.
- * @return 0 if the model is loaded successfully, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK if the model is loaded successfully, and RUNTIME_STATUS_ERROR otherwise.
  */
 int runtime_model_loading(const char *file_path);
 
@@ -64,21 +108,88 @@ int runtime_model_loading(const char *file_path);
  *
  * @param input_tensors The input tensors to feed to the model. Note that the input tensors are completely managed by the caller (both allocation and freeing).
  * @param output_tensors The output tensors computed during inference. Note that the output tensors are completely managed by this function (both allocation and freeing).
- * @return 0 if the execution is successful, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK if the execution is successful, and RUNTIME_STATUS_ERROR, RUNTIME_STATUS_DEVICE_ERROR, RUNTIME_STATUS_INVALID_ARGUMENT or RUNTIME_STATUS_NOT_READY otherwise.
  */
 int runtime_inference_execution(tensors_struct *input_tensors, tensors_struct *output_tensors);
 
+/**
+ * @brief This function is called to execute the model on the input tensors with per-request options.
+ * It behaves like `runtime_inference_execution`, and can be called concurrently from several threads, each thread getting its own output tensors.
+ *
+ * @param input_tensors The input tensors to feed to the model. Note that the input tensors are completely managed by the caller (both allocation and freeing).
+ * @param output_tensors The output tensors computed during inference. Note that the output tensors are completely managed by this function (both allocation and freeing).
+ * @param options The options of the request, e.g. its priority class. NULL selects the defaults.
+ * @return RUNTIME_STATUS_OK if the execution is successful, the codes of `runtime_inference_execution`, and RUNTIME_STATUS_DEADLINE_MISSED, RUNTIME_STATUS_QUEUE_FULL, RUNTIME_STATUS_TIMEOUT or RUNTIME_STATUS_CANCELLED if the request was shed, refused, timed out or cancelled.
+ */
+int runtime_inference_execution_with_options(tensors_struct *input_tensors, tensors_struct *output_tensors, const inference_options *options);
+
+/**
+ * @brief This function is called to get the number of outputs of the loaded model.
+ *
+ * @return The number of outputs, 0 if no model is loaded.
+ */
+size_t runtime_num_outputs();
+
+/**
+ * @brief This function is called to get the layout of an output of the loaded model, which is the layout of the buffers passed to `runtime_inference_execution_into`.
+ *
+ * @param index The index of the output.
+ * @param layout Where the layout is written. Its name and shape are managed by the runtime and valid until `runtime_destruction`.
+ * @return RUNTIME_STATUS_OK if the layout is written, and RUNTIME_STATUS_INVALID_ARGUMENT if no model is loaded or the index is out of range.
+ */
+int runtime_output_layout(size_t index, tensor_layout *layout);
+
+/**
+ * @brief This function is called to execute the model on the input tensors, writing the outputs into buffers of the caller, e.g. a shared-memory segment.
+ * It behaves like `runtime_inference_execution_with_options`, except that the outputs are written straight into the given buffers instead of being held by the runtime until `runtime_inference_cleanup`, which saves a copy of every output.
+ *
+ * @param input_tensors The input tensors to feed to the model. Note that the input tensors are completely managed by the caller (both allocation and freeing).
+ * @param output_buffers One buffer per output, in the layout given by `runtime_output_layout`. Note that the buffers are completely managed by the caller, and are only written during the call.
+ * @param buffer_sizes The size in bytes of each buffer, which must be at least the size of its layout.
+ * @param options The options of the request. NULL selects the defaults.
+ * @return The codes of `runtime_inference_execution_with_options`, with RUNTIME_STATUS_INVALID_ARGUMENT also for a missing or too small buffer.
+ */
+int runtime_inference_execution_into(tensors_struct *input_tensors, void **output_buffers, const size_t *buffer_sizes, const inference_options *options);
+
+/**
+ * @brief This function is called to execute the model on the input tensors, returning a read-only view of the outputs in one of the `result_slots` slots of the runtime.
+ * It behaves like `runtime_inference_execution_with_options`, except that the outputs stay valid until the view is released, whatever the following inferences, so that several results can be held at once without copying them, e.g. while tracking.
+ *
+ * @param input_tensors The input tensors to feed to the model. Note that the input tensors are completely managed by the caller (both allocation and freeing).
+ * @param view Where the view of the outputs is written. The outputs are managed by the runtime and must not be written.
+ * @param options The options of the request. NULL selects the defaults.
+ * @return The codes of `runtime_inference_execution_with_options`, and RUNTIME_STATUS_NO_RESULT_SLOT if every slot is held.
+ */
+int runtime_inference_execution_view(tensors_struct *input_tensors, result_view *view, const inference_options *options);
+
+/**
+ * @brief This function is called to give back the result slot of a view, once its outputs are consumed. This function is thread-safe.
+ *
+ * @param view The view returned by `runtime_inference_execution_view`.
+ * @return RUNTIME_STATUS_OK if the slot is released, and RUNTIME_STATUS_INVALID_ARGUMENT if the view does not hold its slot any more, e.g. when released twice, even after the slot was taken by another inference.
+ */
+int runtime_result_release(const result_view *view);
+
+/**
+ * @brief This function is called to cancel the queued requests of a given tag, e.g. from another thread when their frames became useless.
+ * The requests already sent to the accelerator are not affected. The cancelled requests return RUNTIME_STATUS_CANCELLED.
+ *
+ * @param tag The tag of the requests to cancel, as given in their inference_options.
+ * @return The number of cancelled requests.
+ */
+int runtime_inference_cancel(unsigned long long tag);
+
 /**
  * @brief This function is called after each inference run to clean up the output tensors and any other resources if needed.
  *
- * @return 0 if the cleanup is successful, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK.
  */
 int runtime_inference_cleanup();
 
 /**
  * @brief This function is called to destroy the runtime environment after the inference process is stopped.
  *
- * @return 0 if the finalization is successful, and non-zero otherwise.
+ * @return RUNTIME_STATUS_OK.
  */
 int runtime_destruction();
 
@@ -0,0 +1,62 @@
+#ifndef RUNTIME_DEVICE_HPP
+#define RUNTIME_DEVICE_HPP
+
+#include "runtime_config.hpp"
+#include "memx/MxAccl.h"
+
+#include <vector>
+
+/**
+ * @brief Open the accelerator and load the model from the DFP file.
+ * The model is loaded through MxAccl, which downloads both the weights and the model configuration.
+ * `keep_weights_resident` is refused: the driver cannot report which weights the device holds, so a download of the
+ * model configuration alone cannot be proven to match the weights in place.
+ *
+ * @param file_path The path to the DFP file.
+ * @param config The runtime configuration.
+ * @param model_info Where the information of the loaded model is written.
+ *
+ * @return 0 if the model is loaded successfully, and non-zero otherwise.
+ */
+int device_open(const char *file_path, runtime_config *config, MX::Types::MxModelInfo *model_info);
+
+/**
+ * @brief Start the inference on the accelerator. Must be called once after device_open.
+ * The MxAccl worker counts of the configuration are applied right before.
+ *
+ * @return 0 if the accelerator is started successfully, and non-zero otherwise.
+ */
+int device_start();
+
+/**
+ * @brief Send one frame to the accelerator.
+ *
+ * @param input_data The input data of each input port, in channel last format.
+ *
+ * @return 0 if the frame is sent successfully, and non-zero otherwise.
+ */
+int device_send(std::vector<float*> &input_data);
+
+/**
+ * @brief Receive the outputs of the oldest frame sent to the accelerator.
+ * It waits as long as the accelerator takes, MxAccl cannot time out a frame.
+ *
+ * @param output_data The output buffers of each output port, filled in channel last format.
+ *
+ * @return 0 if the frame is received successfully, and non-zero otherwise.
+ */
+int device_receive(std::vector<float*> &output_data);
+
+/**
+ * @brief Stop the accelerator and release all its resources.
+ */
+void device_close();
+
+/**
+ * @brief Get the worker counts applied to the accelerator, 0 where the vendor default is kept.
+ *
+ * @return The applied settings.
+ */
+device_settings device_applied_settings();
+
+#endif
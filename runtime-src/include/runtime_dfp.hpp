@@ -0,0 +1,29 @@
+#ifndef RUNTIME_DFP_HPP
+#define RUNTIME_DFP_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Ask the kernel to read a DFP file ahead in the background, so that the later parsing and download by MxAccl
+ * are served from the page cache. Nothing is kept open or mapped.
+ *
+ * @param file_path The path to the DFP file.
+ *
+ * @return 0 if the file can be read, and non-zero otherwise.
+ */
+int dfp_prefetch(const char *file_path);
+
+/**
+ * @brief Get a 64-bit fingerprint of the content of a DFP file.
+ * The fingerprints are cached in `/var/tmp` by path, size and modification time, the file is only read when it is
+ * new or has changed.
+ *
+ * @param file_path The path to the DFP file.
+ * @param fingerprint Where the fingerprint is written.
+ *
+ * @return 0 if the fingerprint is written, and non-zero otherwise.
+ */
+int dfp_fingerprint(const char *file_path, uint64_t *fingerprint);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef RUNTIME_EXECUTOR_HPP
+#define RUNTIME_EXECUTOR_HPP
+
+#include <stddef.h>
+#include <sched.h>
+
+// Body of a parallel loop, run on the iterations [begin, end)
+typedef void (*range_function)(void *arg, size_t begin, size_t end);
+
+/**
+ * @brief Start the worker threads running the host-side conversions.
+ * Each worker owns a bounded deque of tasks. A worker splits the ranges it takes in halves, keeps one half and pushes
+ * the other one on its deque, where the idle workers steal it from. Tasks are stored by value in the deques and in a
+ * lock-free injection ring, so that running a loop allocates nothing.
+ *
+ * @param num_workers The number of worker threads, 0 to run every loop on its calling thread.
+ * @param cpus The CPUs of the workers, or an empty set for any.
+ * @param numa_node The NUMA node the workers prefer for their memory, -1 for none.
+ * @param spin_us How long the idle workers busy-poll for work before sleeping.
+ *
+ * @return 0 if the workers are started, and non-zero otherwise.
+ */
+int executor_start(int num_workers, const cpu_set_t *cpus, int numa_node, int spin_us);
+
+/**
+ * @brief Stop the worker threads. No loop may be running.
+ */
+void executor_stop();
+
+/**
+ * @brief Get the number of worker threads.
+ *
+ * @return The number of worker threads, 0 when the executor is stopped.
+ */
+int executor_num_workers();
+
+/**
+ * @brief Change the number of workers taking tasks, the others finish their tasks and sleep until they are needed
+ * again. This function is thread-safe.
+ *
+ * @param count The number of workers, from 0 to executor_num_workers().
+ */
+void executor_set_active_workers(int count);
+
+/**
+ * @brief Get the number of workers taking tasks.
+ *
+ * @return The number of workers set by executor_set_active_workers, all of them by default.
+ */
+int executor_active_workers();
+
+/**
+ * @brief Run a loop of `count` iterations on the calling thread and the workers, and return when it is done.
+ * The calling thread runs its share of the loop, then helps with the tasks left instead of sleeping, so that loops may
+ * be nested. This function is thread-safe.
+ *
+ * @param count The number of iterations.
+ * @param grain The smallest number of iterations worth running as a task of its own.
+ * @param function The body of the loop.
+ * @param arg The argument passed to the body.
+ */
+void executor_parallel_for(size_t count, size_t grain, range_function function, void *arg);
+
+#endif
@@ -8,22 +8,32 @@
 #include <stddef.h>
 #include <stdlib.h>
 
+// Everything the hot path reads about a tensor, on one cache line
+typedef struct alignas(64) tensor_descriptor {
+    const char *name;
+    const size_t *shape;
+    // strides in elements, dense with the last dimension contiguous
+    const size_t *strides;
+    size_t rank;
+    size_t num_elements;
+    // size in bytes of the tensor once converted to float
+    size_t size;
+    tensor_data_type data_type;
+    // feature map of the model the tensor is fed to or read from
+    int port;
+    // converted between this layout (channel first) and the H, W, Z, C layout of the accelerator
+    bool transposed;
+} tensor_descriptor;
+
+// A single allocation holding the descriptors, then their shapes and strides, then their names
 typedef struct io_info {
     // number of inputs and outputs
     size_t num_inputs;
     size_t num_outputs;
-    // names
-    char **input_names;
-    char **output_names;
-    // shapes
-    size_t** input_shapes;
-    size_t** output_shapes;
-    // ranks
-    size_t* input_ranks;
-    size_t* output_ranks;
-    // datatypes
-    tensor_data_type* input_datatypes;
-    tensor_data_type* output_datatypes;
+    const tensor_descriptor *inputs;
+    const tensor_descriptor *outputs;
+    // size of the allocation
+    size_t size;
 } io_info;
 
 /**
@@ -56,6 +66,30 @@ io_info *initialize_io_info(const char *json);
  */
 io_info* initialize_io_info_from_model_info(MX::Types::MxModelInfo &model_info);
 
+/**
+ * @brief Check if a tensor of a given shape is transposed to or from a feature map of the accelerator, which is when
+ * the permutation between them (see device_permutation) moves data.
+ *
+ * @param rank The rank of the tensor.
+ * @param shape The shape of the tensor.
+ * @param featuremap_shape The shape of the feature map.
+ *
+ * @return True if the tensor is transposed, false otherwise.
+ */
+bool shape_needs_transpose(size_t rank, const size_t *shape, MX::Types::ShapeVector &featuremap_shape);
+
+/**
+ * @brief Map the tensors of the io_info structure to the feature maps of the loaded model, and plan their transposes.
+ * The tensors go to the feature maps of the same names when the names match one-to-one, and to the ones of their
+ * indices otherwise. A tensor is transposed when the permutation to its feature map moves data.
+ * This is the only change made to the structure after it is built, before the model is used: the structure is
+ * read-only afterwards, and shared by all threads without locking.
+ *
+ * @param info The io_info structure.
+ * @param model_info The model_info structure of the loaded model.
+ */
+void bind_io_info(io_info *info, MX::Types::MxModelInfo &model_info);
+
 /**
  * @brief Print the io_info structure.
  * 
@@ -0,0 +1,69 @@
+#ifndef RUNTIME_KERNELS_HPP
+#define RUNTIME_KERNELS_HPP
+
+#include "runtime_plan.hpp"
+#include "runtime_executor.hpp"
+
+#include <stddef.h>
+
+// Instruction sets the conversion kernels are built for, the highest one the CPU supports is used by default
+typedef enum conversion_isa {
+    CONVERSION_ISA_GENERIC = 0,     // Portable C++, compiled for the baseline of the target, e.g. SSE2 or NEON
+    CONVERSION_ISA_AVX2 = 1         // x86-64 with AVX2
+} conversion_isa;
+
+#define CONVERSION_ISA_AUTO -1
+
+// The 2D transposes go by square blocks, which stay in the L1 cache between their reads and their writes
+#define TRANSPOSE_BLOCK 8
+
+// A tensor converted with a plan, the argument of the kernels
+typedef struct conversion_job {
+    const conversion_plan *plan;
+    const float *source;
+    float *destination;
+} conversion_job;
+
+typedef struct specialized_kernel {
+    size_t channels;
+    // NULL where the generic transpose is as fast
+    range_function interleave;
+    range_function deinterleave;
+    const char *name;
+} specialized_kernel;
+
+// The kernels of one instruction set
+typedef struct conversion_kernels {
+    conversion_isa isa;
+    const char *name;
+    // Any permutation, by the indices of the first axis of the converted tensor
+    range_function permute;
+    const specialized_kernel *specialized;
+    size_t num_specialized;
+} conversion_kernels;
+
+/**
+ * @brief Get the highest instruction set the CPU supports and the kernels are built for, from CPUID on x86-64.
+ * The other targets run the generic kernels, which are compiled for their baseline (NEON on AArch64).
+ *
+ * @return The instruction set.
+ */
+conversion_isa detect_conversion_isa();
+
+/**
+ * @brief Choose the kernels the plans compiled from now on run. The plans already compiled keep their kernels.
+ *
+ * @param isa The instruction set, or CONVERSION_ISA_AUTO for the one detect_conversion_isa gives.
+ *
+ * @return 0 if the kernels are chosen, and non-zero if the CPU does not support the instruction set.
+ */
+int set_conversion_isa(int isa);
+
+/**
+ * @brief Get the kernels chosen by set_conversion_isa, the ones of CONVERSION_ISA_AUTO until it is called.
+ *
+ * @return The kernels.
+ */
+const conversion_kernels *active_conversion_kernels();
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef RUNTIME_MEMORY_HPP
+#define RUNTIME_MEMORY_HPP
+
+#include <stddef.h>
+
+// Alignment of every tensor buffer, a cache line and the widest SIMD register
+#define TENSOR_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+typedef enum huge_page_mode {
+    HUGE_PAGES_NONE = 0,                // Regular pages only
+    HUGE_PAGES_TRANSPARENT = 1,         // Large buffers are advised to the transparent huge pages of the kernel
+    HUGE_PAGES_EXPLICIT = 2             // Large buffers come from the reserved huge pages, transparent ones when none is left
+} huge_page_mode;
+
+/**
+ * @brief Set how the tensor buffers allocated from now on are backed.
+ *
+ * @param mode The huge_page_mode.
+ */
+void memory_set_huge_pages(int mode);
+
+/**
+ * @brief Allocate a tensor buffer aligned on TENSOR_ALIGNMENT bytes. Buffers of at least half a huge page are mapped on
+ * their own, aligned on huge pages and backed by them as the huge_page_mode allows. This function is thread-safe.
+ *
+ * @param size The size of the buffer in bytes.
+ *
+ * @warning The returned buffer must be freed with tensor_free.
+ *
+ * @return The buffer, or NULL if the memory is exhausted.
+ */
+void *tensor_alloc(size_t size);
+
+/**
+ * @brief Free a buffer of tensor_alloc. A few buffers mapped on huge pages are kept for the next allocations of the same
+ * size, so that the buffers allocated per frame do not fault their pages in again.
+ *
+ * @param data The buffer, or NULL.
+ */
+void tensor_free(void *data);
+
+/**
+ * @brief Give the buffers kept by tensor_free back to the system.
+ */
+void memory_trim();
+
+/**
+ * @brief Get the number of bytes of the live tensor buffers, and how many of them may be backed by huge pages.
+ *
+ * @param total_bytes Where the size of the live buffers is written.
+ * @param huge_page_bytes Where the size of the live buffers mapped on huge pages is written.
+ */
+void memory_usage(size_t *total_bytes, size_t *huge_page_bytes);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef RUNTIME_MEMORY_BENCHMARK_HPP
+#define RUNTIME_MEMORY_BENCHMARK_HPP
+
+/**
+ * @brief Measure the throughput of the input and output transposes on typical feature maps, with their buffers taken
+ * from `malloc` and from tensor_alloc in each huge_page_mode, and print it.
+ * Each tensor is measured twice: allocating a new destination per frame, as the conversions of the runtime do, and
+ * transposing into the same destination again, which leaves out the page faults.
+ *
+ * @param iterations The number of frames per measure.
+ */
+void run_memory_benchmark(int iterations);
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef RUNTIME_PLAN_HPP
+#define RUNTIME_PLAN_HPP
+
+#include "runtime_ioinfo.hpp"
+#include "runtime_executor.hpp"
+#include "memx/MxAccl.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAX_PLAN_RANK 8
+// Shapes of an input port whose plans are kept, the load-time one included
+#define MAX_CACHED_PLANS 8
+
+typedef enum conversion_kind {
+    CONVERSION_NONE = 0,                // The tensor is used as is, the conversion only moves axes of one
+    CONVERSION_PERMUTE = 1,             // The axes of the tensor are permuted, between NCHW and the layout of the accelerator
+    CONVERSION_INVALID = 2              // The tensor needs a conversion the runtime cannot do
+} conversion_kind;
+
+// How to convert a tensor of a given shape, validated once so that running it checks nothing
+typedef struct conversion_plan {
+    uint64_t signature;
+    size_t rank;
+    size_t shape[MAX_PLAN_RANK];
+    conversion_kind kind;
+    // size in bytes of the converted tensor
+    size_t size;
+    // the permutation once the axes of one are dropped and the axes contiguous in both layouts are merged: the axes of
+    // the converted tensor from the outermost, with their strides in elements in the tensor and in the converted one
+    size_t num_axes;
+    size_t extents[MAX_PLAN_RANK];
+    size_t source_strides[MAX_PLAN_RANK];
+    size_t destination_strides[MAX_PLAN_RANK];
+    // the axis contiguous in the tensor, transposed by blocks with the last axis unless it is the last axis
+    size_t inner_axis;
+    // the loop run on the conversion workers, over `num_indices` indices, `grain` of them being worth a task
+    range_function kernel;
+    const char *kernel_name;
+    size_t num_indices;
+    size_t grain;
+    // the generic kernel shares the first axes between the workers, its indices going over all of them, the inner
+    // axis by blocks of rows
+    size_t num_split_axes;
+    size_t split_extents[MAX_PLAN_RANK];
+} conversion_plan;
+
+/**
+ * @brief Get the permutation from the channel-first layout of an ONNX tensor to the H, W, Z, C layout of the
+ * accelerator: the channels go last, and the depth of 3D feature maps goes after the height and the width.
+ *
+ * @param rank The rank of the tensor.
+ * @param permutation Where the permutation is written, the axis of the tensor each axis of the converted one is from.
+ */
+void channel_last_permutation(size_t rank, size_t *permutation);
+
+/**
+ * @brief Get the permutation from a tensor to a feature map of the accelerator. The tensor is used as is when its
+ * shape and the one of the feature map only differ by ones, and is converted channel last otherwise.
+ *
+ * @param rank The rank of the tensor.
+ * @param shape The shape of the tensor.
+ * @param featuremap_shape The H, W, Z, C shape of the feature map.
+ * @param permutation Where the permutation is written, the axis of the tensor each axis of the converted one is from.
+ *
+ * @return 0 if the tensor matches the feature map as is or channel last, 1 if it matches neither and is assumed
+ * channel first, and 2 if their numbers of elements differ.
+ */
+int device_permutation(size_t rank, const size_t *shape, MX::Types::ShapeVector &featuremap_shape, size_t *permutation);
+
+/**
+ * @brief Check if a permutation moves data, which is not the case when it only moves axes of one.
+ *
+ * @param rank The rank of the tensor.
+ * @param shape The shape of the tensor.
+ * @param permutation The permutation.
+ *
+ * @return True if the permutation moves data, false if it is a reshape.
+ */
+bool permutation_moves_data(size_t rank, const size_t *shape, const size_t *permutation);
+
+/**
+ * @brief Get the signature of a shape, which differs for all the shapes a port sees in practice.
+ *
+ * @param rank The rank of the shape.
+ * @param shape The shape.
+ *
+ * @return The signature.
+ */
+uint64_t shape_signature(size_t rank, const size_t *shape);
+
+/**
+ * @brief Build the plan permuting the axes of a float tensor, of any rank up to MAX_PLAN_RANK. The axes of one are
+ * dropped and the axes contiguous in both layouts are merged, so that a permutation which only moves axes of one is a
+ * CONVERSION_NONE reshape, and the NCHW to NHWC transpose is a 2D transpose per image. The 2D transposes of one image
+ * to or from 3 or 4 channels, and from 32, 64, 80, 85 or 255 channels, run a kernel compiled for that number of
+ * channels, and the others the generic permutation. The reason a shape cannot be converted is printed once here, and the plan is then
+ * CONVERSION_INVALID.
+ *
+ * @param rank The rank of the tensor.
+ * @param shape The shape of the tensor, before the conversion.
+ * @param permutation The axis of the tensor each axis of the converted one is from.
+ * @param plan Where the plan is written.
+ *
+ * @return 0 if the plan can run, and non-zero otherwise.
+ */
+int compile_conversion_plan(size_t rank, const size_t *shape, const size_t *permutation, conversion_plan *plan);
+
+/**
+ * @brief Make a plan run the generic permutation instead of the kernel specialized for its number of channels, to
+ * compare them.
+ *
+ * @param plan The plan, of kind CONVERSION_PERMUTE.
+ */
+void use_generic_kernel(conversion_plan *plan);
+
+/**
+ * @brief Convert a tensor with a plan, on the calling thread and the conversion workers.
+ *
+ * @param plan The plan.
+ * @param source The tensor.
+ * @param destination Where the converted tensor is written, of `plan->size` bytes. Unused for CONVERSION_NONE.
+ *
+ * @return 0 if the tensor is converted, and non-zero for a CONVERSION_INVALID plan.
+ */
+int run_conversion_plan(const conversion_plan *plan, const float *source, float *destination);
+
+/**
+ * @brief Build the plans of every port of the loaded model, for the shapes of its io_info.
+ *
+ * @param info The io_info structure, bound to the model.
+ * @param model_info The model_info structure of the loaded model.
+ *
+ * @return 0 if the plans are built, and non-zero otherwise.
+ */
+int plans_build(const io_info *info, MX::Types::MxModelInfo &model_info);
+
+/**
+ * @brief Free the plans.
+ */
+void plans_free();
+
+/**
+ * @brief Get the plan of an input for the shape of the tensor a caller passes.
+ * The plan of the shape last seen is checked first by signature, and the plan of a new shape is built and kept the
+ * first time it appears. This function is thread-safe, and only takes a lock to keep a new plan.
+ *
+ * @param index The index of the input.
+ * @param rank The rank of the tensor.
+ * @param shape The shape of the tensor.
+ * @param fallback Where the plan is built when the port already keeps MAX_CACHED_PLANS plans.
+ *
+ * @return The plan.
+ */
+const conversion_plan *find_input_plan(size_t index, size_t rank, const size_t *shape, conversion_plan *fallback);
+
+/**
+ * @brief Get the plan of an output, whose shape is fixed by the io_info.
+ *
+ * @param index The index of the output.
+ *
+ * @return The plan.
+ */
+const conversion_plan *output_plan(size_t index);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef RUNTIME_QUEUE_BENCHMARK_HPP
+#define RUNTIME_QUEUE_BENCHMARK_HPP
+
+/**
+ * @brief Measure the throughput of the lock-free mpmc_ring against the mutex-based `sync_queue` and
+ * `MX::Utils::fifo_queue` of MxAccl, from 1 to `max_threads` threads in powers of two, and print it.
+ * Half of the threads push and the other half pop, a single thread alternates pushes and pops. `fifo_queue` can only be
+ * polled for items, which is not safe with several consumers, so it is always drained by a single consumer.
+ *
+ * @param max_threads The largest number of threads.
+ * @param items The number of items going through each queue per measure.
+ */
+void run_queue_benchmark(int max_threads, int items);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef RUNTIME_RESULTS_HPP
+#define RUNTIME_RESULTS_HPP
+
+#include "runtime_ioinfo.hpp"
+
+/**
+ * @brief Allocate a ring of result slots, each holding one set of output tensors of the model.
+ * A slot is taken by an inference, which writes its outputs into it, and stays taken until the caller releases it, so
+ * that callers may keep several results at once without copying them.
+ *
+ * @param info The io_info structure of the model.
+ * @param num_slots The number of slots, 0 for none.
+ *
+ * @return 0 if the slots are allocated, and non-zero otherwise.
+ */
+int results_allocate(io_info *info, int num_slots);
+
+/**
+ * @brief Free the result slots, including the ones still taken.
+ */
+void results_free();
+
+/**
+ * @brief Take a free slot. The slots are tried in turn from the one after the last taken. This function is
+ * thread-safe and lock-free.
+ *
+ * @param generation Where the generation of the slot is written, which its release must give.
+ *
+ * @return The index of the slot, or -1 if every slot is taken.
+ */
+int results_acquire(unsigned *generation);
+
+/**
+ * @brief Get the output tensors of a taken slot.
+ *
+ * @param slot The index of the slot.
+ *
+ * @return The output tensors of the slot.
+ */
+tensors_struct *results_tensors(int slot);
+
+/**
+ * @brief Give back a taken slot. This function is thread-safe and lock-free.
+ *
+ * @param slot The index of the slot.
+ * @param generation The generation the slot was taken with.
+ *
+ * @return 0 if the slot is released, and non-zero if it is not taken, or was released and taken again since.
+ */
+int results_release(int slot, unsigned generation);
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef RUNTIME_RING_HPP
+#define RUNTIME_RING_HPP
+
+#include "runtime_threads.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @brief A point where threads sleep until a condition becomes true, after busy-polling it.
+ * The signalling side only takes the lock when a thread sleeps, so that a hand-off between two busy threads stays
+ * lock-free.
+ */
+class wait_point {
+public:
+    wait_point() : sleepers(0) {}
+
+    /**
+     * @brief Wait until a condition becomes true.
+     *
+     * @param ready The condition, which must be safe to evaluate without any lock, and become true before notify().
+     * @param spin_us How long to busy-poll before sleeping, 0 to sleep right away.
+     */
+    template <typename Ready>
+    void wait(Ready ready, double spin_us){
+        if (spin_until(ready, spin_us))
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        cv.wait(lock, ready);
+        sleepers.fetch_sub(1);
+    }
+
+    /**
+     * @brief Wait until a condition becomes true, or for at most a given time.
+     *
+     * @param ready The condition, as for wait().
+     * @param spin_us How long to busy-poll before sleeping.
+     * @param timeout_us How long to wait in total.
+     *
+     * @return True if the condition became true.
+     */
+    template <typename Ready>
+    bool wait_for(Ready ready, double spin_us, double timeout_us){
+        if (spin_until(ready, std::min(spin_us, timeout_us)))
+            return true;
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool done = cv.wait_for(lock, std::chrono::duration<double, std::micro>(timeout_us), ready);
+        sleepers.fetch_sub(1);
+        return done;
+    }
+
+    /**
+     * @brief Wake up the sleeping threads, after the condition they wait for changed.
+     */
+    void notify(){
+        // Pairs with the fence of wait(): either the sleeper sees the change, or this sees the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        cv.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<int> sleepers;
+};
+
+/**
+ * @brief A bounded lock-free ring between exactly one producer thread and one consumer thread.
+ * The producer and consumer indices live on their own cache lines, and each side caches the index of the other one,
+ * so that the shared lines are only read again when the ring looks full or empty.
+ */
+template <typename T>
+class spsc_ring {
+public:
+    /**
+     * @param capacity The number of items the ring holds, rounded up to a power of two.
+     */
+    explicit spsc_ring(size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    /**
+     * @brief Add an item, from the producer thread.
+     *
+     * @param item The item.
+     *
+     * @return False if the ring is full.
+     */
+    bool try_push(const T &item){
+        size_t position = tail.load(std::memory_order_relaxed);
+        if (position - cached_head > mask){
+            cached_head = head.load(std::memory_order_acquire);
+            if (position - cached_head > mask)
+                return false;
+        }
+        slots[position & mask] = item;
+        tail.store(position + 1, std::memory_order_release);
+        not_empty.notify();
+        return true;
+    }
+
+    /**
+     * @brief Take the oldest item, from the consumer thread.
+     *
+     * @param item Where the item is written.
+     *
+     * @return False if the ring is empty.
+     */
+    bool try_pop(T &item){
+        size_t position = head.load(std::memory_order_relaxed);
+        if (position == cached_tail){
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (position == cached_tail)
+                return false;
+        }
+        item = slots[position & mask];
+        head.store(position + 1, std::memory_order_release);
+        not_full.notify();
+        return true;
+    }
+
+    /**
+     * @brief Add an item, from the producer thread, waiting for room if the ring is full.
+     *
+     * @param item The item.
+     * @param spin_us How long to busy-poll before sleeping.
+     */
+    void push(const T &item, double spin_us){
+        while (!try_push(item))
+            not_full.wait([this]{ return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) <= mask; }, spin_us);
+    }
+
+    /**
+     * @brief Take the oldest item, from the consumer thread, waiting for one if the ring is empty.
+     *
+     * @param item Where the item is written.
+     * @param spin_us How long to busy-poll before sleeping.
+     */
+    void pop(T &item, double spin_us){
+        while (!try_pop(item))
+            not_empty.wait([this]{ return tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed); }, spin_us);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // consumer line: its index, and the index of the producer as last seen
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    size_t cached_tail;
+    // producer line
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    size_t cached_head;
+    alignas(CACHE_LINE_SIZE) wait_point not_empty;
+    wait_point not_full;
+};
+
+/**
+ * @brief A bounded lock-free ring for any number of producer and consumer threads (D. Vyukov's bounded MPMC queue).
+ * Each slot carries a sequence number telling whether it is free for the producer of a given turn or holds the item of
+ * that turn for a consumer, so that a push or a pop is one compare-and-swap on the shared index, and threads only
+ * contend on the index they advance.
+ */
+template <typename T>
+class mpmc_ring {
+public:
+    /**
+     * @param capacity The number of items the ring holds, rounded up to a power of two.
+     */
+    explicit mpmc_ring(size_t capacity) : head(0), tail(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        slots = std::vector<slot>(size);
+        for (size_t i = 0; i < size; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    /**
+     * @brief Number of items in the ring, which may already be stale when it returns.
+     */
+    size_t size() const {
+        size_t position = head.load(std::memory_order_acquire);
+        return tail.load(std::memory_order_acquire) - position;
+    }
+
+    /**
+     * @brief Add an item. This function is thread-safe.
+     *
+     * @param item The item.
+     *
+     * @return False if the ring is full.
+     */
+    bool try_push(const T &item){
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true){
+            slot &cell = slots[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0){
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    cell.item = item;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    not_empty.notify();
+                    return true;
+                }
+            } else if (difference < 0){
+                // The slot still holds the item of the previous turn
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Take the oldest item. This function is thread-safe.
+     *
+     * @param item Where the item is written.
+     *
+     * @return False if the ring is empty.
+     */
+    bool try_pop(T &item){
+        size_t position = head.load(std::memory_order_relaxed);
+        while (true){
+            slot &cell = slots[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+            if (difference == 0){
+                if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)){
+                    item = cell.item;
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    not_full.notify();
+                    return true;
+                }
+            } else if (difference < 0){
+                return false;
+            } else {
+                position = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Add an item, waiting for room if the ring is full. This function is thread-safe.
+     *
+     * @param item The item.
+     * @param spin_us How long to busy-poll before sleeping.
+     */
+    void push(const T &item, double spin_us){
+        while (!try_push(item))
+            not_full.wait([this]{ return size() <= mask; }, spin_us);
+    }
+
+    /**
+     * @brief Take the oldest item, waiting for one if the ring is empty. This function is thread-safe.
+     *
+     * @param item Where the item is written.
+     * @param spin_us How long to busy-poll before sleeping.
+     */
+    void pop(T &item, double spin_us){
+        while (!try_pop(item))
+            not_empty.wait([this]{ return size() > 0; }, spin_us);
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        T item;
+        slot() : sequence(0), item() {}
+        slot(const slot &other) : sequence(other.sequence.load(std::memory_order_relaxed)), item(other.item) {}
+    };
+    std::vector<slot> slots;
+    size_t mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    alignas(CACHE_LINE_SIZE) wait_point not_empty;
+    wait_point not_full;
+};
+
+#endif
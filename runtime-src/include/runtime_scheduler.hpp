@@ -0,0 +1,140 @@
+#ifndef RUNTIME_SCHEDULER_HPP
+#define RUNTIME_SCHEDULER_HPP
+
+#include "runtime_core.hpp"
+#include "runtime_config.hpp"
+#include "runtime_stats.hpp"
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Data conversions of a request, between the layouts of the caller and the channel last layout of the accelerator
+typedef struct request_conversions {
+    // fill the input data of the request, and transform its outputs, RUNTIME_STATUS_OK on success
+    int (*convert_inputs)(void *job);
+    int (*convert_outputs)(void *job);
+    void *job;
+} request_conversions;
+
+typedef struct inference_request {
+    // data of the frame, in channel last format
+    std::vector<float*> *input_data;
+    std::vector<float*> *output_data;
+    // conversions run by the pipeline stages, NULL when the caller runs them
+    const request_conversions *conversions;
+    // priority class, INFERENCE_PRIORITY_HIGH first
+    int priority;
+    // caller-chosen tag for scheduler_cancel
+    unsigned long long tag;
+    // fail with RUNTIME_STATUS_QUEUE_FULL instead of waiting for room in the queue
+    bool try_submit;
+    // set by scheduler_cancel while the request waits to enter the queue, or for the gate
+    bool cancelled;
+    // batcher: queued, taken in a batch, or abandoned with RUNTIME_STATUS_TIMEOUT or RUNTIME_STATUS_CANCELLED
+    std::atomic<int> state;
+    // time at which the request entered the queue
+    double enqueue_us;
+    // time by which the outputs are needed, 0 for no deadline
+    double deadline_us;
+    // time by which the frame must be sent, 0 to wait forever
+    double timeout_us;
+    // time at which the frame was sent to the accelerator
+    double send_us;
+    // completion
+    int status;
+    std::atomic<bool> done;
+    std::mutex mutex;
+    std::condition_variable cv;
+} inference_request;
+
+// Snapshot of the host-side queue, for the adaptive controller
+typedef struct scheduler_load {
+    // requests waiting to be sent
+    size_t pending;
+    // frames sent and not output yet
+    size_t in_flight;
+    size_t in_flight_limit;
+    // moving average of the time the accelerator takes per frame, 0 until measured
+    double frame_service_us;
+} scheduler_load;
+
+/**
+ * @brief Start the host-side queue in front of the accelerator.
+ * Without `dynamic_batching`, the callers send their frames themselves, one frame at a time, and the waiting callers
+ * are let through by priority class.
+ * With `dynamic_batching`, requests submitted by concurrent callers are coalesced up to `max_batch_size` requests, or
+ * until the oldest one waited `max_queue_delay_us`, and sent back-to-back to the accelerator by a dedicated thread.
+ * Another thread receives the outputs in order, so that several batches stay in flight.
+ * In both modes, the time the accelerator takes per frame is measured, so that
+ * requests with a deadline can be shed when they cannot finish in time.
+ * With `spin_us`, the batcher threads and the waiting callers busy-poll before sleeping, and its send and receive
+ * threads can be pinned to `scheduler_cpus` and run with the SCHED_FIFO `realtime_priority`.
+ * With `max_queue_depth`, at most that many requests wait for the accelerator, and the next callers wait for room
+ * or fail right away.
+ * With `pipeline` on top of `dynamic_batching`, the input and output conversions move from the callers to stages of
+ * their own, so that each frame goes through four threads: input conversion, send, receive and output conversion.
+ * They hand the frames to each other through lock-free single-producer single-consumer rings, and each one can be
+ * pinned to its own CPU of `pipeline_cpus`, so that the throughput is bounded by the slowest stage rather than by the
+ * sum of the stages.
+ *
+ * @param config The runtime configuration.
+ * @param stats The runtime_stats structure where the batch sizes and queue wait times are recorded.
+ *
+ * @return 0 if the queue is started, and non-zero otherwise.
+ */
+int scheduler_start(runtime_config *config, runtime_stats *stats);
+
+/**
+ * @brief Submit one frame to the accelerator and wait for its outputs.
+ * Queued requests of a higher priority class are sent first. This function is thread-safe.
+ * A request with a deadline is refused right away when the measured device latency and the frames ahead of it in the
+ * queue say it cannot finish in time, and it is dropped before being sent if its deadline became unreachable while
+ * it was waiting.
+ * A request that is not sent before its timeout leaves the queue. Once sent, its outputs are waited for as long as the
+ * accelerator takes, MxAccl cannot time out a frame.
+ *
+ * @param input_data The input data of each input port, in channel last format, filled by the input conversion if any.
+ * @param output_data The output buffers of each output port, filled in channel last format.
+ * @param conversions The conversions of the frame, run by the caller or by the pipeline stages, or NULL for none.
+ * @param options The options of the request. Its deadline and timeout are relative to `call_us`.
+ * @param call_us The time of the call to the runtime, on the stats_now_us clock.
+ *
+ * @return RUNTIME_STATUS_OK if the inference is successful, the status of a failed conversion, and otherwise
+ * RUNTIME_STATUS_DEVICE_ERROR, RUNTIME_STATUS_INVALID_ARGUMENT for an invalid priority class, RUNTIME_STATUS_NOT_READY
+ * if the queue is stopped, or the RUNTIME_STATUS_* code of a request shed, refused, timed out or cancelled.
+ */
+int scheduler_submit(std::vector<float*> &input_data, std::vector<float*> &output_data,
+                     const request_conversions *conversions, const inference_options *options, double call_us);
+
+/**
+ * @brief Read the current load of the host-side queue. This function is thread-safe.
+ *
+ * @param load Where the snapshot is written.
+ */
+void scheduler_read_load(scheduler_load *load);
+
+/**
+ * @brief Change the number of frames the batcher keeps in flight on the accelerator. The frames already in flight
+ * are not affected, the batcher waits for them to drain below a lowered limit. This function is thread-safe.
+ *
+ * @param limit The number of frames, at least 1. The batches are cut to fit in it.
+ */
+void scheduler_set_in_flight_limit(size_t limit);
+
+/**
+ * @brief Cancel the requests of a given tag that are not sent to the accelerator yet. This function is thread-safe.
+ *
+ * @param tag The tag of the requests to cancel.
+ *
+ * @return The number of cancelled requests.
+ */
+int scheduler_cancel(unsigned long long tag);
+
+/**
+ * @brief Stop the host-side queue. The frames in flight are received, and the requests still queued fail.
+ */
+void scheduler_stop();
+
+#endif
@@ -0,0 +1,200 @@
+#ifndef RUNTIME_STATS_HPP
+#define RUNTIME_STATS_HPP
+
+#include "runtime_core.hpp"
+#include "runtime_config.hpp"
+
+#include <stddef.h>
+#include <mutex>
+#include <chrono>
+#include <vector>
+
+typedef struct latency_summary {
+    size_t count;
+    double total_us;
+    double min_us;
+    double max_us;
+} latency_summary;
+
+// Stages of an inference timed by the runtime, besides the wait in the host-side queue
+typedef enum runtime_stage {
+    STAGE_INPUT_CONVERSION,     // caller layout to the channel last layout of the accelerator
+    STAGE_DEVICE,               // from the send of the frame to its outputs
+    STAGE_OUTPUT_CONVERSION,    // channel last outputs back to the layout of the caller
+    NUM_RUNTIME_STAGES
+} runtime_stage;
+
+typedef struct runtime_stats {
+    std::mutex mutex;
+    // model loading, from the DFP download to the end of the warm-up
+    double model_loading_us;
+    // worker counts applied to the accelerator
+    device_settings device;
+    // warm-up phase run at model loading
+    size_t warmup_iterations;
+    double warmup_total_us;
+    // very first inference on the accelerator (warm-up or not)
+    double first_inference_us;
+    // first inference requested by the caller, after the warm-up
+    double first_request_us;
+    // steady state: every caller inference after the first one
+    latency_summary steady_state;
+    size_t num_inferences;
+    // dynamic batching: number of batches per batch size
+    std::vector<size_t> batch_sizes;
+    // time spent in the host-side queue, per priority class
+    latency_summary queue_wait[NUM_INFERENCE_PRIORITIES];
+    // time spent in each stage
+    latency_summary stages[NUM_RUNTIME_STAGES];
+    // deadlines: requests refused when submitted, dropped before being sent, and outputs received too late
+    size_t shed_at_admission;
+    size_t shed_in_queue;
+    size_t late_results;
+    // requests refused by a full queue, timed out, and cancelled
+    size_t queue_full;
+    size_t timeouts;
+    size_t cancelled;
+    // adaptive controller: frames allowed in flight, and its changes (0 when the controller is off)
+    size_t in_flight_limit;
+    size_t in_flight_limit_min;
+    size_t in_flight_limit_max;
+    // conversion workers taking tasks, while the controller steers them (0 without conversion_threads)
+    int conversion_workers;
+    int conversion_workers_min;
+    int conversion_workers_max;
+    size_t controller_raises;
+    size_t controller_lowers;
+} runtime_stats;
+
+/**
+ * @brief Get the current time in microseconds from a monotonic clock.
+ *
+ * @return The current time in microseconds.
+ */
+static inline double stats_now_us(){
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Reset all counters of the runtime_stats structure.
+ *
+ * @param stats The runtime_stats structure to reset.
+ */
+void reset_runtime_stats(runtime_stats *stats);
+
+/**
+ * @brief Add one sample to a latency summary.
+ *
+ * @param summary The latency summary to update.
+ * @param latency_us The latency in microseconds.
+ */
+void latency_summary_add(latency_summary *summary, double latency_us);
+
+/**
+ * @brief Record the duration of the model loading.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param duration_us The duration in microseconds.
+ */
+void stats_record_model_loading(runtime_stats *stats, double duration_us);
+
+/**
+ * @brief Record the worker counts applied to the accelerator.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param settings The applied settings, 0 where the vendor default is kept.
+ */
+void stats_record_device_settings(runtime_stats *stats, device_settings settings);
+
+/**
+ * @brief Record the latency of one warm-up inference run at model loading.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param latency_us The latency in microseconds.
+ */
+void stats_record_warmup(runtime_stats *stats, double latency_us);
+
+/**
+ * @brief Record the latency of one inference requested by the caller.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param latency_us The latency in microseconds.
+ */
+void stats_record_inference(runtime_stats *stats, double latency_us);
+
+/**
+ * @brief Record the size of one batch sent to the accelerator.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param batch_size The number of requests in the batch.
+ */
+void stats_record_batch(runtime_stats *stats, size_t batch_size);
+
+/**
+ * @brief Record the time one request waited in the queue before being sent to the accelerator.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param priority The priority class of the request.
+ * @param wait_us The wait time in microseconds.
+ */
+void stats_record_queue_wait(runtime_stats *stats, int priority, double wait_us);
+
+/**
+ * @brief Record the time one inference spent in a stage.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param stage The stage.
+ * @param duration_us The duration in microseconds.
+ */
+void stats_record_stage(runtime_stats *stats, runtime_stage stage, double duration_us);
+
+/**
+ * @brief Record one request shed because it could not meet its deadline.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param in_queue True if the request was dropped after waiting in the queue, false if it was refused when submitted.
+ */
+void stats_record_shed(runtime_stats *stats, bool in_queue);
+
+/**
+ * @brief Record one output received after the deadline of its request.
+ *
+ * @param stats The runtime_stats structure to update.
+ */
+void stats_record_late(runtime_stats *stats);
+
+/**
+ * @brief Record one request refused by a full queue, timed out, or cancelled.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param status The exit code of the request: RUNTIME_STATUS_QUEUE_FULL, RUNTIME_STATUS_TIMEOUT or RUNTIME_STATUS_CANCELLED.
+ */
+void stats_record_dropped(runtime_stats *stats, int status);
+
+/**
+ * @brief Record the number of frames the adaptive controller allows in flight, when it starts and when it changes it.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param limit The new number of frames allowed in flight.
+ * @param direction 1 if the controller raised it, -1 if it lowered it, and 0 for its initial value.
+ */
+void stats_record_in_flight_limit(runtime_stats *stats, size_t limit, int direction);
+
+/**
+ * @brief Record the number of conversion workers the adaptive controller lets take tasks, when it starts and when it
+ * changes it.
+ *
+ * @param stats The runtime_stats structure to update.
+ * @param count The new number of conversion workers.
+ * @param direction 1 if the controller raised it, -1 if it lowered it, and 0 for its initial value.
+ */
+void stats_record_conversion_workers(runtime_stats *stats, int count, int direction);
+
+/**
+ * @brief Print the runtime_stats structure.
+ *
+ * @param stats The runtime_stats structure to print.
+ */
+void print_runtime_stats(runtime_stats *stats);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef RUNTIME_THREADS_HPP
+#define RUNTIME_THREADS_HPP
+
+#include "runtime_stats.hpp"
+
+#include <sched.h>
+
+/**
+ * @brief Parse a list of CPUs, e.g. "0-3,8,10-11".
+ *
+ * @param value The null-terminated list of CPUs.
+ * @param cpus Where the set of CPUs is written.
+ *
+ * @return 0 if the list is valid and not empty, and non-zero otherwise.
+ */
+int parse_cpu_list(const char *value, cpu_set_t *cpus);
+
+/**
+ * @brief Format a set of CPUs as a list, e.g. "0-3,8".
+ *
+ * @param cpus The set of CPUs.
+ * @param buffer Where the null-terminated list is written.
+ * @param length The size of the buffer.
+ */
+void format_cpu_list(const cpu_set_t *cpus, char *buffer, size_t length);
+
+/**
+ * @brief Pin the calling thread to a set of CPUs, and optionally give it a real-time priority.
+ * Failures are reported as warnings, e.g. SCHED_FIFO needs CAP_SYS_NICE, and the thread keeps running.
+ *
+ * @param name The name of the thread, used in the warnings.
+ * @param cpus The CPUs the thread may run on, or NULL or an empty set to leave its affinity unchanged.
+ * @param realtime_priority The SCHED_FIFO priority of the thread from 1 to 99, or 0 to leave its policy unchanged.
+ */
+void configure_current_thread(const char *name, const cpu_set_t *cpus, int realtime_priority);
+
+/**
+ * @brief Get the CPUs of a NUMA node from sysfs.
+ *
+ * @param node The NUMA node.
+ * @param cpus Where the set of CPUs is written.
+ *
+ * @return 0 if the node exists and has CPUs, and non-zero otherwise.
+ */
+int numa_node_cpus(int node, cpu_set_t *cpus);
+
+/**
+ * @brief Make the memory first touched by the calling thread come from a NUMA node, when the node has free memory.
+ *
+ * @param node The NUMA node, or -1 to go back to the default local allocation.
+ */
+void prefer_numa_node(int node);
+
+#define MAX_NUMA_NODES 1024
+
+// CPU affinity and memory policy of a thread, as saved by save_thread_placement
+typedef struct thread_placement {
+    bool has_cpus;
+    cpu_set_t cpus;
+    bool has_policy;
+    int policy;
+    unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))];
+} thread_placement;
+
+/**
+ * @brief Save the CPU affinity and the memory policy of the calling thread, before the runtime changes them.
+ *
+ * @param placement Where the placement is written. What cannot be read is left out and is not restored.
+ */
+void save_thread_placement(thread_placement *placement);
+
+/**
+ * @brief Give the calling thread back the CPU affinity and the memory policy saved by save_thread_placement.
+ *
+ * @param placement The saved placement.
+ */
+void restore_thread_placement(const thread_placement *placement);
+
+static inline void cpu_relax(){
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * @brief Add the time a thread spent busy-polling to the total of the process.
+ *
+ * @param spin_us The time spent, in microseconds.
+ */
+void record_spin_time(double spin_us);
+
+/**
+ * @brief Get the time the threads of the process spent busy-polling in spin_until, which is CPU time that the adaptive
+ * controller does not count as work.
+ *
+ * @return The total time in microseconds.
+ */
+double total_spin_us();
+
+/**
+ * @brief Busy-poll a condition for a while before the caller parks on its condition variable.
+ * Spinning trades one CPU for the wake-up latency of the scheduler when the condition is about to become true. The
+ * time spent is recorded with record_spin_time.
+ *
+ * @param ready The condition, which must be safe to evaluate without any lock.
+ * @param spin_us How long to spin in microseconds, 0 to return right away.
+ *
+ * @return True if the condition became true while spinning, false otherwise.
+ */
+template <typename Ready>
+static inline bool spin_until(Ready ready, double spin_us){
+    if (spin_us <= 0 || ready())
+        return ready();
+    double start_us = stats_now_us();
+    double end_us = start_us + spin_us;
+    for (unsigned i = 0; !ready(); i++){
+        // Reading the clock costs more than a pause, check it every few iterations only
+        if ((i & 63) == 63){
+            double now_us = stats_now_us();
+            if (now_us >= end_us){
+                record_spin_time(now_us - start_us);
+                return false;
+            }
+        }
+        cpu_relax();
+    }
+    record_spin_time(stats_now_us() - start_us);
+    return true;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef RUNTIME_TUNER_HPP
+#define RUNTIME_TUNER_HPP
+
+#include "runtime_config.hpp"
+
+/**
+ * @brief Pick the device settings, the batching and the frames in flight of a model for this host.
+ * The settings are read from the `autotune_cache` file when it has an entry for the same DFP content, host and latency
+ * budget. Otherwise every candidate setting is loaded in turn and fed synthetic frames from enough threads to fill the
+ * deepest pipeline, the candidate with the best throughput whose p99 latency stays within
+ * `autotune_latency_budget_us` is kept, or the one with the lowest p99 latency when none does, and the cache is
+ * updated. With `simulated_device_us`, the cache is neither read nor written, the results do not describe the device.
+ * The accelerator is closed again when this function returns.
+ *
+ * @param file_path The path to the DFP file.
+ * @param config The runtime configuration, whose device settings, batching and frames in flight are replaced by the
+ * tuned ones.
+ *
+ * @return 0 if the configuration is tuned, and non-zero otherwise, in which case it is left unchanged.
+ */
+int tune_runtime(const char *file_path, runtime_config *config);
+
+#endif
@@ -29,13 +29,25 @@ bool input_needs_transpose(int input_index, MX::Types::MxModelInfo &model_info,
  * @param input_index The index of the input tensor.
  * @param input_tensors The input tensors.
  * 
- * @warning The returned data must be freed by the caller.
+ * @warning The returned data must be freed by the caller with tensor_free.
  * @warning The returned data can be NULL for invalid input tensors. 
  * 
  * @return The transposed input data.
 */
 float *transpose_input_data(int input_index, tensors_struct *input_tensors);
 
+/**
+ * @brief Transpose the input data from channel first to the H, W, Z, C layout of the accelerator into a given buffer,
+ * for any rank and batch (see channel_last_permutation).
+ *
+ * @param input_index The index of the input tensor.
+ * @param input_tensors The input tensors.
+ * @param transposed_data Where the transposed data is written, of the size of the input tensor.
+ *
+ * @return 0 if the data is transposed, and non-zero for invalid input tensors.
+*/
+int transpose_input_data_into(int input_index, tensors_struct *input_tensors, float *transposed_data);
+
 /**
  * @brief Check if the output needs to be transposed from NHWC to NCHW.
  * 
@@ -53,13 +65,25 @@ bool output_needs_transpose(int output_index, MX::Types::MxModelInfo &model_info
  * @param output_index The index of the output tensor.
  * @param output_tensors The output tensors.
  * 
- * @warning The returned data must be freed by the caller.
+ * @warning The returned data must be freed by the caller with tensor_free.
  * @warning The returned data can be NULL for invalid output tensors. 
  * 
  * @return The transposed output data.
 */
 float *transpose_output_data(int output_index, tensors_struct *output_tensors);
 
+/**
+ * @brief Transpose the output data from the H, W, Z, C layout of the accelerator to channel first into a given buffer,
+ * e.g. one of the caller, for any rank and batch.
+ *
+ * @param output_index The index of the output tensor.
+ * @param output_tensors The output tensors.
+ * @param transposed_data Where the transposed data is written, of the size of the output tensor.
+ *
+ * @return 0 if the data is transposed, and non-zero for invalid output tensors.
+*/
+int transpose_output_data_into(int output_index, tensors_struct *output_tensors, float *transposed_data);
+
 /**
  * @brief Allocate the output tensors.
  * It sets all fields of the output_tensors structure except the data field, which is just allocated.
@@ -69,6 +93,15 @@ float *transpose_output_data(int output_index, tensors_struct *output_tensors);
  */
 void allocate_output_tensors(tensors_struct *output_tensors, io_info *info);
 
+/**
+ * @brief Allocate zero-filled input tensors shaped from the io_info structure.
+ * It is used to push synthetic inputs through the runtime, e.g. during the warm-up.
+ * 
+ * @param input_tensors The input tensors to allocate. They must be freed with free_tensors_struct.
+ * @param info The io_info structure.
+ */
+void allocate_synthetic_input_tensors(tensors_struct *input_tensors, io_info *info);
+
 
 /**
  * @brief Free the tensors_struct structure.
@@ -1,6 +1,18 @@
 #include "runtime_core.hpp"
+#include "runtime_ioinfo.hpp"
+#include "runtime_utils.hpp"
+#include "runtime_stats.hpp"
+#include "runtime_queue_benchmark.hpp"
+#include "runtime_memory_benchmark.hpp"
+#include "runtime_conversion_benchmark.hpp"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
 
 char *read_json(const char *json_path){
     FILE *fp;
@@ -31,27 +43,234 @@ char *read_json(const char *json_path){
         return NULL;
     }
 
+    buffer[lSize] = '\0';
     fclose(fp);
     return buffer;
 }
 
+// Latencies of every benchmark inference, per calling thread
+static std::vector<std::vector<double>> benchmark_latencies;
+
+static void benchmark_thread(io_info *info, int thread_index, int iterations){
+    tensors_struct input_tensors;
+    tensors_struct output_tensors;
+    allocate_synthetic_input_tensors(&input_tensors, info);
+    std::vector<double> &latencies = benchmark_latencies[thread_index];
+    for (int i = 0; i < iterations; i++){
+        double start = stats_now_us();
+        if (runtime_inference_execution(&input_tensors, &output_tensors) == 0)
+            latencies.push_back(stats_now_us() - start);
+        runtime_inference_cleanup();
+    }
+    free_tensors_struct(&input_tensors);
+}
+
+static double percentile(std::vector<double> &sorted, double p){
+    return sorted[std::min(sorted.size() - 1, (size_t)(p / 100.0 * sorted.size()))];
+}
+
+typedef struct benchmark_summary {
+    double throughput;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double stddev_us;
+} benchmark_summary;
+
+/**
+ * Run `iterations` inferences from each of `threads` threads, and print the latency distribution.
+ * The jitter is the spread between the median and the tail latency.
+ */
+static benchmark_summary run_benchmark(io_info *info, int threads, int iterations){
+    benchmark_summary summary = {0, 0, 0, 0, 0};
+    benchmark_latencies.assign(threads, std::vector<double>());
+    double start = stats_now_us();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+        workers.push_back(std::thread(benchmark_thread, info, t, iterations));
+    for (std::thread &worker : workers)
+        worker.join();
+    double elapsed_us = stats_now_us() - start;
+
+    std::vector<double> latencies;
+    for (std::vector<double> &thread_latencies : benchmark_latencies)
+        latencies.insert(latencies.end(), thread_latencies.begin(), thread_latencies.end());
+    if (latencies.empty()){
+        printf("Benchmark: no successful inference\n");
+        return summary;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0;
+    for (double latency : latencies)
+        sum += latency;
+    double mean = sum / latencies.size();
+    double variance = 0;
+    for (double latency : latencies)
+        variance += (latency - mean) * (latency - mean);
+    double p50 = percentile(latencies, 50);
+    double p99 = percentile(latencies, 99);
+    printf("Benchmark: %zu inferences from %d threads, %.1f inferences/s\n", latencies.size(), threads,
+           latencies.size() / (elapsed_us / 1e6));
+    printf("Latency: mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", mean, p50,
+           percentile(latencies, 90), p99, percentile(latencies, 99.9), latencies.back());
+    printf("Jitter: stddev %.1f us, p99 - p50 %.1f us\n", sqrt(variance / latencies.size()), p99 - p50);
+    summary.throughput = latencies.size() / (elapsed_us / 1e6);
+    summary.mean_us = mean;
+    summary.p50_us = p50;
+    summary.p99_us = p99;
+    summary.stddev_us = sqrt(variance / latencies.size());
+    return summary;
+}
+
+/**
+ * Run the benchmark once per placement, each with its own runtime, and print them side by side.
+ * Placements are separated by `;`, and each one is a space-separated list of `key=value` runtime arguments added to
+ * the common ones, or `default`, e.g. "default;numa_node=0;numa_node=1;accl_cpus=0-3 conversion_cpus=4-7 pin_callers=1".
+ */
+static void compare_placements(const char *model_path, char *json, std::vector<const char *> &keys,
+                               std::vector<const void *> &values, const char *placements, int threads, int iterations){
+    std::vector<std::string> names;
+    std::vector<benchmark_summary> summaries;
+    std::string list(placements);
+    size_t begin = 0;
+    while (begin <= list.size()){
+        size_t end = list.find(';', begin);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string placement = list.substr(begin, end - begin);
+        begin = end + 1;
+        if (placement.empty())
+            continue;
+
+        // Split the placement into its arguments, kept alive until the runtime is initialized
+        std::vector<std::string> arguments;
+        size_t position = 0;
+        while (position < placement.size()){
+            size_t next = placement.find(' ', position);
+            if (next == std::string::npos)
+                next = placement.size();
+            if (next > position)
+                arguments.push_back(placement.substr(position, next - position));
+            position = next + 1;
+        }
+        std::vector<std::string> argument_keys;
+        std::vector<std::string> argument_values;
+        for (std::string &argument : arguments){
+            size_t equal = argument.find('=');
+            if (argument == "default")
+                continue;
+            if (equal == std::string::npos){
+                printf("Error: invalid placement argument `%s`\n", argument.c_str());
+                return;
+            }
+            argument_keys.push_back(argument.substr(0, equal));
+            argument_values.push_back(argument.substr(equal + 1));
+        }
+        std::vector<const char *> placement_keys = keys;
+        std::vector<const void *> placement_values = values;
+        for (size_t i = 0; i < argument_keys.size(); i++){
+            placement_keys.push_back(argument_keys[i].c_str());
+            placement_values.push_back(argument_values[i].c_str());
+        }
+
+        printf("Placement `%s`\n", placement.c_str());
+        if (runtime_initialization_with_args(placement_keys.size(), placement_keys.data(), placement_values.data()) != 0 ||
+            runtime_model_loading(model_path) != 0){
+            printf("Error: cannot load the model with the placement `%s`\n", placement.c_str());
+            runtime_destruction();
+            continue;
+        }
+        io_info *info = initialize_io_info(json);
+        names.push_back(placement);
+        summaries.push_back(run_benchmark(info, threads, iterations));
+        free_io_info(info);
+        runtime_destruction();
+    }
+
+    printf("Placement comparison:\n");
+    for (size_t i = 0; i < names.size(); i++)
+        printf("%-40s %10.1f inferences/s, mean %.1f us, p50 %.1f us, p99 %.1f us, stddev %.1f us\n", names[i].c_str(),
+               summaries[i].throughput, summaries[i].mean_us, summaries[i].p50_us, summaries[i].p99_us, summaries[i].stddev_us);
+}
+
 int main(int argc, char *argv[]){
-    if (argc < 2){
-        printf("Usage: %s <model_path>\n", argv[0]);
+    if (argc < 2 || argc % 2 != 0){
+        printf("Usage: %s <model_path> [<key> <value>]...\n", argv[0]);
+        printf("The keys `iterations` and `threads` run a latency benchmark, `placements` compares it across placements,\n"
+               "`queue_benchmark` compares the host-side queues up to that many threads, `memory_benchmark` compares the tensor\n"
+               "allocators over that many frames, `conversion_benchmark` compares the conversion kernels over that many frames,\n"
+               "the other keys are passed to the runtime\n");
         return 1;
     }
+    double start = stats_now_us();
     char *model_path = argv[1];
     const char *json_path = "io.json";
     char *json = read_json(json_path);
-    const char *keys[] = {"json"};
-    const void *values[] = {json};
+    std::vector<const char *> keys = {"json"};
+    std::vector<const void *> values = {json};
+    int iterations = 0;
+    int threads = 1;
+    const char *placements = NULL;
+    for (int i = 2; i + 1 < argc; i += 2){
+        if (strcmp(argv[i], "iterations") == 0){
+            iterations = atoi(argv[i + 1]);
+            continue;
+        }
+        if (strcmp(argv[i], "threads") == 0){
+            threads = std::max(1, atoi(argv[i + 1]));
+            continue;
+        }
+        if (strcmp(argv[i], "placements") == 0){
+            placements = argv[i + 1];
+            continue;
+        }
+        if (strcmp(argv[i], "queue_benchmark") == 0){
+            run_queue_benchmark(std::max(1, atoi(argv[i + 1])), 1 << 20);
+            free(json);
+            return 0;
+        }
+        if (strcmp(argv[i], "memory_benchmark") == 0){
+            run_memory_benchmark(std::max(1, atoi(argv[i + 1])));
+            free(json);
+            return 0;
+        }
+        if (strcmp(argv[i], "conversion_benchmark") == 0){
+            run_conversion_benchmark(std::max(1, atoi(argv[i + 1])));
+            free(json);
+            return 0;
+        }
+        keys.push_back(argv[i]);
+        values.push_back(argv[i + 1]);
+    }
 
-    int exit_code = runtime_initialization_with_args(1, keys, values);
+    int exit_code = runtime_initialization_with_args(keys.size(), keys.data(), values.data());
     printf("runtime_initialization_with_args's exit_code: %d\n", exit_code);
     
     exit_code = runtime_model_loading(model_path);
     printf("runtime_model_loading's exit_code: %d\n", exit_code);
+    if (exit_code != 0)
+        return exit_code;
+
+    // Time from the process start to the first inference, i.e. the cost of a restart
+    io_info *info = initialize_io_info(json);
+    tensors_struct input_tensors;
+    tensors_struct output_tensors;
+    allocate_synthetic_input_tensors(&input_tensors, info);
+    exit_code = runtime_inference_execution(&input_tensors, &output_tensors);
+    printf("runtime_inference_execution's exit_code: %d\n", exit_code);
+    printf("Restart to first inference: %.1f ms\n", (stats_now_us() - start) / 1000.0);
+    runtime_inference_cleanup();
+
+    if (iterations > 0)
+        run_benchmark(info, threads, iterations);
 
+    free_tensors_struct(&input_tensors);
+    free_io_info(info);
+    runtime_destruction();
 
-    return 0;
-}
\ No newline at end of file
+    if (placements != NULL && iterations > 0)
+        compare_placements(model_path, json, keys, values, placements, threads, iterations);
+    free(json);
+
+    return exit_code;
+}
@@ -0,0 +1,63 @@
+#include "runtime_arena.hpp"
+#include "runtime_memory.hpp"
+
+#include <stdio.h>
+
+static size_t align_size(size_t size){
+    return (size + TENSOR_ALIGNMENT - 1) / TENSOR_ALIGNMENT * TENSOR_ALIGNMENT;
+}
+
+int arena_init(scratch_arena *arena, size_t capacity){
+    arena->capacity = align_size(capacity);
+    arena->used = 0;
+    arena->requested = 0;
+    arena->overflow.clear();
+    arena->base = NULL;
+    if (arena->capacity == 0)
+        return 0;
+    arena->base = (char *)tensor_alloc(arena->capacity);
+    if (arena->base == NULL){
+        printf("Error: cannot allocate a scratch arena of %zu bytes\n", arena->capacity);
+        arena->capacity = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void *arena_alloc(scratch_arena *arena, size_t size){
+    size = align_size(size);
+    arena->requested += size;
+    if (arena->capacity - arena->used >= size){
+        void *buffer = arena->base + arena->used;
+        arena->used += size;
+        return buffer;
+    }
+    void *buffer = tensor_alloc(size);
+    if (buffer != NULL)
+        arena->overflow.push_back(buffer);
+    return buffer;
+}
+
+void arena_reset(scratch_arena *arena){
+    if (!arena->overflow.empty()){
+        for (void *buffer : arena->overflow)
+            tensor_free(buffer);
+        arena->overflow.clear();
+        // Grow to what the last requests needed, the old contents are all dropped
+        tensor_free(arena->base);
+        arena_init(arena, arena->requested);
+    }
+    arena->used = 0;
+    arena->requested = 0;
+}
+
+void arena_free(scratch_arena *arena){
+    for (void *buffer : arena->overflow)
+        tensor_free(buffer);
+    arena->overflow.clear();
+    tensor_free(arena->base);
+    arena->base = NULL;
+    arena->capacity = 0;
+    arena->used = 0;
+    arena->requested = 0;
+}
@@ -0,0 +1,192 @@
+#include "runtime_config.hpp"
+#include "runtime_threads.hpp"
+#include "runtime_memory.hpp"
+#include "runtime_kernels.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+
+typedef enum argument_type {
+    ARGUMENT_INT,
+    ARGUMENT_BOOL,
+    ARGUMENT_CPUS,
+    ARGUMENT_PATH
+} argument_type;
+
+typedef struct runtime_argument {
+    const char *key;
+    argument_type type;
+    size_t offset;      // offset of the field in the runtime_config structure
+    int min_value;      // only for ARGUMENT_INT
+    int max_value;      // only for ARGUMENT_INT
+} runtime_argument;
+
+static const runtime_argument arguments[] = {
+    {"warmup_iterations", ARGUMENT_INT, offsetof(runtime_config, warmup_iterations), 0, INT_MAX},
+    {"keep_weights_resident", ARGUMENT_BOOL, offsetof(runtime_config, keep_weights_resident), 0, 0},
+    {"simulated_device_us", ARGUMENT_INT, offsetof(runtime_config, simulated_device_us), 0, INT_MAX},
+    {"dynamic_batching", ARGUMENT_BOOL, offsetof(runtime_config, dynamic_batching), 0, 0},
+    {"max_batch_size", ARGUMENT_INT, offsetof(runtime_config, max_batch_size), 1, INT_MAX},
+    {"max_queue_delay_us", ARGUMENT_INT, offsetof(runtime_config, max_queue_delay_us), 0, INT_MAX},
+    {"max_in_flight", ARGUMENT_INT, offsetof(runtime_config, max_in_flight), 0, INT_MAX},
+    {"max_queue_depth", ARGUMENT_INT, offsetof(runtime_config, max_queue_depth), 0, INT_MAX},
+    {"spin_us", ARGUMENT_INT, offsetof(runtime_config, spin_us), 0, INT_MAX},
+    {"realtime_priority", ARGUMENT_INT, offsetof(runtime_config, realtime_priority), 0, 99},
+    {"scheduler_cpus", ARGUMENT_CPUS, offsetof(runtime_config, scheduler_cpus), 0, 0},
+    {"accl_cpus", ARGUMENT_CPUS, offsetof(runtime_config, accl_cpus), 0, 0},
+    {"conversion_cpus", ARGUMENT_CPUS, offsetof(runtime_config, conversion_cpus), 0, 0},
+    {"pin_callers", ARGUMENT_BOOL, offsetof(runtime_config, pin_callers), 0, 0},
+    {"conversion_threads", ARGUMENT_INT, offsetof(runtime_config, conversion_threads), 0, 256},
+    {"conversion_isa", ARGUMENT_INT, offsetof(runtime_config, conversion_isa), -1, 1},
+    {"pipeline", ARGUMENT_BOOL, offsetof(runtime_config, pipeline), 0, 0},
+    {"pipeline_cpus", ARGUMENT_CPUS, offsetof(runtime_config, pipeline_cpus), 0, 0},
+    {"result_slots", ARGUMENT_INT, offsetof(runtime_config, result_slots), 0, 1024},
+    {"huge_pages", ARGUMENT_INT, offsetof(runtime_config, huge_pages), 0, 2},
+    {"numa_node", ARGUMENT_INT, offsetof(runtime_config, numa_node), -1, INT_MAX},
+    {"input_workers", ARGUMENT_INT, offsetof(runtime_config, device.input_workers), 0, INT_MAX},
+    {"output_workers", ARGUMENT_INT, offsetof(runtime_config, device.output_workers), 0, INT_MAX},
+    {"autotune", ARGUMENT_BOOL, offsetof(runtime_config, autotune), 0, 0},
+    {"autotune_latency_budget_us", ARGUMENT_INT, offsetof(runtime_config, autotune_latency_budget_us), 0, INT_MAX},
+    {"autotune_iterations", ARGUMENT_INT, offsetof(runtime_config, autotune_iterations), 1, INT_MAX},
+    {"autotune_cache", ARGUMENT_PATH, offsetof(runtime_config, autotune_cache), 0, 0},
+    {"adaptive", ARGUMENT_BOOL, offsetof(runtime_config, adaptive), 0, 0},
+    {"adaptive_interval_ms", ARGUMENT_INT, offsetof(runtime_config, adaptive_interval_ms), 1, INT_MAX},
+    {"adaptive_max_in_flight", ARGUMENT_INT, offsetof(runtime_config, adaptive_max_in_flight), 0, INT_MAX},
+};
+
+static int parse_int(const char *value, int min_value, int max_value, int *out){
+    if (value == NULL)
+        return 1;
+    char *end = NULL;
+    errno = 0;
+    long parsed = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || parsed < min_value || parsed > max_value)
+        return 1;
+    *out = (int) parsed;
+    return 0;
+}
+
+static int parse_path(const char *value, char *out){
+    if (value == NULL || *value == '\0' || strlen(value) >= RUNTIME_PATH_LENGTH)
+        return 1;
+    strcpy(out, value);
+    return 0;
+}
+
+static int parse_bool(const char *value, int *out){
+    if (value == NULL)
+        return 1;
+    if (strcmp(value, "1") == 0 || strcmp(value, "true") == 0){
+        *out = 1;
+        return 0;
+    }
+    if (strcmp(value, "0") == 0 || strcmp(value, "false") == 0){
+        *out = 0;
+        return 0;
+    }
+    return 1;
+}
+
+runtime_config default_runtime_config(){
+    runtime_config config;
+    config.warmup_iterations = 0;
+    config.keep_weights_resident = 0;
+    config.simulated_device_us = 0;
+    config.dynamic_batching = 0;
+    config.max_batch_size = 4;
+    config.max_queue_delay_us = 500;
+    config.max_in_flight = 0;
+    config.max_queue_depth = 0;
+    config.spin_us = 0;
+    config.realtime_priority = 0;
+    CPU_ZERO(&config.scheduler_cpus);
+    CPU_ZERO(&config.accl_cpus);
+    CPU_ZERO(&config.conversion_cpus);
+    config.pin_callers = 0;
+    config.conversion_threads = 0;
+    config.conversion_isa = CONVERSION_ISA_AUTO;
+    config.pipeline = 0;
+    CPU_ZERO(&config.pipeline_cpus);
+    config.result_slots = 4;
+    config.huge_pages = HUGE_PAGES_TRANSPARENT;
+    config.numa_node = -1;
+    config.device = device_settings{0, 0};
+    config.autotune = 0;
+    config.autotune_latency_budget_us = 0;
+    config.autotune_iterations = 200;
+    strcpy(config.autotune_cache, "/var/tmp/mxa_autotune.cache");
+    config.adaptive = 0;
+    config.adaptive_interval_ms = 100;
+    config.adaptive_max_in_flight = 0;
+    return config;
+}
+
+int parse_runtime_argument(runtime_config *config, const char *key, const char *value){
+    for (size_t i = 0; i < sizeof(arguments) / sizeof(arguments[0]); i++){
+        const runtime_argument *argument = &arguments[i];
+        if (strcmp(key, argument->key) != 0)
+            continue;
+        void *field = (char *)config + argument->offset;
+        int exit_code = 1;
+        switch (argument->type){
+            case ARGUMENT_INT:
+                exit_code = parse_int(value, argument->min_value, argument->max_value, (int *)field);
+                break;
+            case ARGUMENT_BOOL:
+                exit_code = parse_bool(value, (int *)field);
+                break;
+            case ARGUMENT_CPUS:
+                exit_code = parse_cpu_list(value, (cpu_set_t *)field);
+                break;
+            case ARGUMENT_PATH:
+                exit_code = parse_path(value, (char *)field);
+                break;
+        }
+        if (exit_code != 0)
+            printf("Error: invalid value for `%s`\n", key);
+        return exit_code;
+    }
+    return -1;
+}
+
+int resolve_runtime_placement(runtime_config *config){
+    if (config->numa_node < 0)
+        return 0;
+    cpu_set_t node_cpus;
+    if (numa_node_cpus(config->numa_node, &node_cpus) != 0){
+        printf("Error: cannot find the CPUs of the NUMA node %d\n", config->numa_node);
+        return 1;
+    }
+    cpu_set_t *cpu_sets[] = {&config->scheduler_cpus, &config->accl_cpus, &config->conversion_cpus};
+    for (cpu_set_t *cpus : cpu_sets){
+        if (CPU_COUNT(cpus) == 0)
+            *cpus = node_cpus;
+    }
+    return 0;
+}
+
+void print_runtime_config(runtime_config *config){
+    printf("Runtime configuration:\n");
+    for (size_t i = 0; i < sizeof(arguments) / sizeof(arguments[0]); i++){
+        const runtime_argument *argument = &arguments[i];
+        const void *field = (const char *)config + argument->offset;
+        switch (argument->type){
+            case ARGUMENT_INT:
+            case ARGUMENT_BOOL:
+                printf("%s: %d\n", argument->key, *(const int *)field);
+                break;
+            case ARGUMENT_CPUS: {
+                char cpus[256];
+                format_cpu_list((const cpu_set_t *)field, cpus, sizeof(cpus));
+                printf("%s: %s\n", argument->key, cpus[0] ? cpus : "any");
+                break;
+            }
+            case ARGUMENT_PATH:
+                printf("%s: %s\n", argument->key, (const char *)field);
+                break;
+        }
+    }
+}
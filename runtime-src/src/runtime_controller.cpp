@@ -0,0 +1,238 @@
+#include "runtime_controller.hpp"
+#include "runtime_scheduler.hpp"
+#include "runtime_threads.hpp"
+#include "runtime_executor.hpp"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+// Consecutive periods a signal must hold before the controller acts on it
+#define HYSTERESIS_PERIODS 3
+// Periods ignored after a change, while the pipeline settles
+#define SETTLE_PERIODS 2
+// Periods without raising after a raise that did not pay off, doubled for each one in a row
+#define HOLD_PERIODS 20
+#define MAX_HOLD_DOUBLINGS 4
+// Throughput a raise must bring to be kept
+#define MIN_RAISE_GAIN 1.05
+// Share of the CPUs above which more frames in flight would only starve the conversions
+#define CPU_BUSY 0.9
+// Device time over the best one seen, above which the frames mostly wait inside the accelerator
+#define DEVICE_QUEUEING 1.5
+
+// Cumulated counters at one point in time, the controller works on the difference between two of them
+typedef struct controller_sample {
+    double time_us;
+    // CPU time of the process, busy-polling excluded
+    double cpu_us;
+    latency_summary queue_wait;
+    latency_summary device;
+    latency_summary conversions;
+} controller_sample;
+
+typedef struct controller_state {
+    size_t max_limit;
+    int raise_votes;
+    int lower_votes;
+    int settle_periods;
+    int hold_periods;
+    int failed_raises;
+    // a raise waits for its throughput to be compared with the one before it
+    bool checking_raise;
+    double throughput_before_raise;
+    double best_device_us;
+    // conversion workers the controller may let take tasks, 0 without conversion_threads
+    int max_workers;
+    int worker_raise_votes;
+    int worker_lower_votes;
+} controller_state;
+
+static std::thread controller_thread;
+static std::mutex controller_mutex;
+static std::condition_variable controller_cv;
+static bool running = false;
+
+static double process_cpu_us(){
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void take_sample(runtime_stats *stats, controller_sample *sample){
+    sample->time_us = stats_now_us();
+    sample->cpu_us = process_cpu_us() - total_spin_us();
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    sample->queue_wait = latency_summary{0, 0, 0, 0};
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        sample->queue_wait.count += stats->queue_wait[p].count;
+        sample->queue_wait.total_us += stats->queue_wait[p].total_us;
+    }
+    sample->device = stats->stages[STAGE_DEVICE];
+    sample->conversions = stats->stages[STAGE_INPUT_CONVERSION];
+    sample->conversions.count += stats->stages[STAGE_OUTPUT_CONVERSION].count;
+    sample->conversions.total_us += stats->stages[STAGE_OUTPUT_CONVERSION].total_us;
+}
+
+static void change_limit(runtime_stats *stats, controller_state *state, size_t limit, int direction){
+    scheduler_set_in_flight_limit(limit);
+    stats_record_in_flight_limit(stats, limit, direction);
+    state->raise_votes = 0;
+    state->lower_votes = 0;
+    state->settle_periods = SETTLE_PERIODS;
+}
+
+static void change_workers(runtime_stats *stats, controller_state *state, int count, int direction){
+    executor_set_active_workers(count);
+    stats_record_conversion_workers(stats, count, direction);
+    state->worker_raise_votes = 0;
+    state->worker_lower_votes = 0;
+    state->settle_periods = SETTLE_PERIODS;
+}
+
+static void control_period(runtime_stats *stats, controller_state *state, controller_sample *previous, int num_cpus){
+    controller_sample current;
+    take_sample(stats, &current);
+    scheduler_load load;
+    scheduler_read_load(&load);
+    size_t frames = current.device.count - previous->device.count;
+    size_t sent = current.queue_wait.count - previous->queue_wait.count;
+    double elapsed_us = current.time_us - previous->time_us;
+    double cpu = std::max(0.0, current.cpu_us - previous->cpu_us) / (elapsed_us * num_cpus);
+    double device_us = frames > 0 ? (current.device.total_us - previous->device.total_us) / frames : 0;
+    // Input and output conversions of a frame
+    double conversion_us = frames > 0 ? (current.conversions.total_us - previous->conversions.total_us) / frames : 0;
+    double queue_wait_us = sent > 0 ? (current.queue_wait.total_us - previous->queue_wait.total_us) / sent : 0;
+    *previous = current;
+
+    // Nothing to learn from an idle accelerator
+    if (frames == 0){
+        state->raise_votes = 0;
+        state->lower_votes = 0;
+        state->worker_raise_votes = 0;
+        state->worker_lower_votes = 0;
+        return;
+    }
+    double throughput = frames / (elapsed_us / 1e6);
+    if (state->best_device_us <= 0 || device_us < state->best_device_us)
+        state->best_device_us = device_us;
+    if (state->hold_periods > 0)
+        state->hold_periods--;
+    if (state->settle_periods > 0){
+        state->settle_periods--;
+        return;
+    }
+
+    size_t limit = load.in_flight_limit;
+    if (state->checking_raise){
+        state->checking_raise = false;
+        if (throughput < MIN_RAISE_GAIN * state->throughput_before_raise){
+            change_limit(stats, state, limit - 1, -1);
+            state->hold_periods = HOLD_PERIODS << std::min(state->failed_raises, MAX_HOLD_DOUBLINGS);
+            state->failed_raises++;
+            return;
+        }
+        state->failed_raises = 0;
+    }
+
+    // Requests wait on the host longer than the accelerator takes per frame
+    bool backlog = load.pending > 0 || queue_wait_us > load.frame_service_us;
+    bool cpu_busy = cpu > CPU_BUSY;
+    bool device_queueing = device_us > DEVICE_QUEUEING * state->best_device_us;
+    // More room only helps when the frames in flight fill the current one
+    bool limit_reached = load.in_flight + 1 >= limit;
+    bool raise = backlog && limit_reached && !cpu_busy && state->hold_periods == 0 && limit < state->max_limit;
+    bool lower = (cpu_busy || (!backlog && device_queueing)) && limit > 1;
+    state->raise_votes = raise ? state->raise_votes + 1 : 0;
+    state->lower_votes = lower ? state->lower_votes + 1 : 0;
+
+    // More workers while the conversions of a frame outlast its time on the accelerator and CPU time is left, fewer
+    // before fewer frames in flight when the CPUs are busy
+    int workers = executor_active_workers();
+    bool conversion_bound = load.frame_service_us > 0 && conversion_us > load.frame_service_us;
+    bool raise_workers = backlog && conversion_bound && !cpu_busy && workers < state->max_workers;
+    bool lower_workers = cpu_busy && workers > 0;
+    state->worker_raise_votes = raise_workers ? state->worker_raise_votes + 1 : 0;
+    state->worker_lower_votes = lower_workers ? state->worker_lower_votes + 1 : 0;
+    if (state->worker_raise_votes >= HYSTERESIS_PERIODS){
+        change_workers(stats, state, workers + 1, 1);
+        return;
+    }
+    if (state->worker_lower_votes >= HYSTERESIS_PERIODS){
+        change_workers(stats, state, workers - 1, -1);
+        state->lower_votes = 0;
+        return;
+    }
+    if (lower_workers)
+        state->lower_votes = 0;
+
+    if (state->raise_votes >= HYSTERESIS_PERIODS){
+        change_limit(stats, state, limit + 1, 1);
+        state->checking_raise = true;
+        state->throughput_before_raise = throughput;
+    } else if (state->lower_votes >= HYSTERESIS_PERIODS){
+        change_limit(stats, state, limit - 1, -1);
+    }
+}
+
+static void control_loop(runtime_stats *stats, int interval_ms, size_t max_limit, cpu_set_t cpus, int num_cpus){
+    configure_current_thread("controller", &cpus, 0);
+
+    controller_state state = {max_limit, 0, 0, 0, 0, 0, false, 0, 0, executor_num_workers(), 0, 0};
+    controller_sample previous;
+    take_sample(stats, &previous);
+    std::unique_lock<std::mutex> lock(controller_mutex);
+    while (running){
+        controller_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), []{ return !running; });
+        if (running)
+            control_period(stats, &state, &previous, num_cpus);
+    }
+}
+
+int controller_start(runtime_config *config, runtime_stats *stats){
+    if (!config->adaptive)
+        return 0;
+    if (!config->dynamic_batching){
+        printf("Warning: the adaptive controller needs dynamic_batching, it is disabled\n");
+        return 0;
+    }
+    if (running){
+        printf("Error: the adaptive controller is already started\n");
+        return 1;
+    }
+    size_t max_limit = config->adaptive_max_in_flight > 0 ? config->adaptive_max_in_flight
+                                                          : 4 * std::max(1, config->max_batch_size);
+    scheduler_load load;
+    scheduler_read_load(&load);
+    size_t limit = std::min(load.in_flight_limit, max_limit);
+    scheduler_set_in_flight_limit(limit);
+    stats_record_in_flight_limit(stats, limit, 0);
+    if (executor_num_workers() > 0)
+        stats_record_conversion_workers(stats, executor_active_workers(), 0);
+
+    // The CPUs the process may use, read here since the controller thread is pinned to the scheduler CPUs
+    cpu_set_t process_cpus;
+    int num_cpus = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &process_cpus) == 0)
+        num_cpus = CPU_COUNT(&process_cpus);
+    running = true;
+    controller_thread = std::thread(control_loop, stats, config->adaptive_interval_ms, max_limit, config->scheduler_cpus,
+                                    std::max(1, num_cpus));
+    return 0;
+}
+
+void controller_stop(){
+    {
+        std::lock_guard<std::mutex> lock(controller_mutex);
+        if (!running)
+            return;
+        running = false;
+    }
+    controller_cv.notify_all();
+    controller_thread.join();
+}
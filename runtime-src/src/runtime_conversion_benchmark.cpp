@@ -0,0 +1,111 @@
+#include "runtime_conversion_benchmark.hpp"
+#include "runtime_plan.hpp"
+#include "runtime_kernels.hpp"
+#include "runtime_memory.hpp"
+#include "runtime_stats.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+typedef struct benchmark_feature_map {
+    size_t batch;
+    size_t channels;
+    size_t height;
+    size_t width;
+} benchmark_feature_map;
+
+// Microseconds per frame of a plan
+static double measure_plan(const conversion_plan *plan, const float *source, float *destination, int iterations){
+    // One frame first, to fault the destination in
+    run_conversion_plan(plan, source, destination);
+    double start_us = stats_now_us();
+    for (int i = 0; i < iterations; i++)
+        run_conversion_plan(plan, source, destination);
+    return (stats_now_us() - start_us) / iterations;
+}
+
+// The table of the kernels of the instruction set chosen
+static void benchmark_kernels(int iterations){
+    // An RGB and an RGBA input, backbone feature maps, and detection heads, one frame and then batched
+    const benchmark_feature_map feature_maps[] = {
+        {1, 3, 640, 640},
+        {1, 4, 640, 640},
+        {1, 16, 160, 160},
+        {1, 32, 160, 160},
+        {1, 64, 160, 160},
+        {1, 80, 80, 80},
+        {1, 85, 80, 80},
+        {1, 255, 80, 80},
+        {4, 3, 540, 960},
+        {8, 3, 224, 224},
+        {4, 64, 80, 80},
+        {2, 255, 40, 40},
+    };
+    printf("Conversion benchmark: %s kernels, %d frames, us per frame, generic / specialized kernel\n",
+           active_conversion_kernels()->name, iterations);
+    printf("%-18s %30s %30s\n", "feature map", "to channel last (input)", "from channel last (output)");
+    for (const benchmark_feature_map &feature_map : feature_maps){
+        size_t shape[4] = {feature_map.batch, feature_map.channels, feature_map.height, feature_map.width};
+        size_t permutation[4], device_shape[4], inverse[4];
+        channel_last_permutation(4, permutation);
+        for (size_t d = 0; d < 4; d++){
+            device_shape[d] = shape[permutation[d]];
+            inverse[permutation[d]] = d;
+        }
+        conversion_plan plans[2];
+        compile_conversion_plan(4, shape, permutation, &plans[0]);
+        compile_conversion_plan(4, device_shape, inverse, &plans[1]);
+        conversion_plan generic = plans[0];
+        use_generic_kernel(&generic);
+        range_function generic_kernel = generic.kernel;
+
+        float *source = (float *)tensor_alloc(plans[0].size);
+        float *destination = (float *)tensor_alloc(plans[0].size);
+        if (source == NULL || destination == NULL){
+            tensor_free(source);
+            tensor_free(destination);
+            printf("Error: cannot allocate the tensors of the conversion benchmark\n");
+            return;
+        }
+        for (size_t i = 0; i < plans[0].size / sizeof(float); i++)
+            source[i] = (float)i;
+
+        double generic_us[2], specialized_us[2];
+        for (int direction = 0; direction < 2; direction++){
+            specialized_us[direction] = plans[direction].kernel == generic_kernel ? 0 :
+                                        measure_plan(&plans[direction], source, destination, iterations);
+            generic = plans[direction];
+            use_generic_kernel(&generic);
+            generic_us[direction] = measure_plan(&generic, source, destination, iterations);
+        }
+        tensor_free(source);
+        tensor_free(destination);
+
+        char label[32];
+        if (feature_map.batch > 1)
+            snprintf(label, sizeof(label), "%zux%zux%zux%zu", feature_map.batch, feature_map.channels,
+                     feature_map.height, feature_map.width);
+        else
+            snprintf(label, sizeof(label), "%zux%zux%zu", feature_map.channels, feature_map.height, feature_map.width);
+        printf("%-18s", label);
+        for (int direction = 0; direction < 2; direction++){
+            // The directions without a specialized kernel are only measured with the generic one
+            if (plans[direction].kernel == generic_kernel)
+                printf(" %9.1f / %7s        ", generic_us[direction], "-");
+            else
+                printf(" %9.1f / %7.1f (x%.2f)", generic_us[direction], specialized_us[direction],
+                       generic_us[direction] / specialized_us[direction]);
+        }
+        printf("\n");
+    }
+}
+
+void run_conversion_benchmark(int iterations){
+    conversion_isa chosen = active_conversion_kernels()->isa;
+    for (int isa = CONVERSION_ISA_GENERIC; isa <= detect_conversion_isa(); isa++){
+        if (set_conversion_isa(isa) != 0)
+            continue;
+        benchmark_kernels(iterations);
+    }
+    set_conversion_isa(chosen);
+}
@@ -1,21 +1,288 @@
 #include "runtime_core.hpp"
 #include "runtime_utils.hpp"
 #include "runtime_ioinfo.hpp"
+#include "runtime_config.hpp"
+#include "runtime_stats.hpp"
+#include "runtime_device.hpp"
+#include "runtime_scheduler.hpp"
+#include "runtime_threads.hpp"
+#include "runtime_tuner.hpp"
+#include "runtime_controller.hpp"
+#include "runtime_executor.hpp"
+#include "runtime_results.hpp"
+#include "runtime_memory.hpp"
+#include "runtime_arena.hpp"
+#include "runtime_plan.hpp"
+#include "runtime_kernels.hpp"
 #include "memx/MxAccl.h"
 
+#include <mutex>
+#include <atomic>
+
 
-static MX::Runtime::MxAccl *accl = NULL;
 static MX::Types::MxModelInfo model_info;
-static std::vector<float*> input_data;
-static std::vector<float*> output_data;
+static io_info *info = NULL;
 
-static vector<bool> input_transposed;
+static runtime_config config = default_runtime_config();
+static runtime_stats stats;
+static const inference_options default_options = {INFERENCE_PRIORITY_NORMAL, 0, 0, 0, 0};
+
+// Each calling thread gets its own output tensors, so that concurrent callers don't overwrite each other
+typedef struct inference_context {
+    tensors_struct output_tensors;
+    // indexed by feature map
+    std::vector<float*> input_data;
+    std::vector<float*> output_data;
+    // indexed by tensor, the plans of the shapes of the request, and the plans of the shapes no port keeps
+    std::vector<const conversion_plan*> input_plans;
+    std::vector<conversion_plan> fallback_plans;
+    // where each output is transposed to, NULL when the accelerator writes it in place
+    std::vector<float*> output_destinations;
+    // outputs handed to the caller, the device buffers or their transposes
+    std::vector<void*> result_data;
+    // the transposes of the request, until the next request or runtime_inference_cleanup
+    scratch_arena arena;
+    // request being run, for the conversions
+    tensors_struct *input_tensors;
+    // buffers of the caller the outputs are written to, NULL to keep them in output_tensors
+    void **caller_outputs;
+    std::atomic<bool> conversion_failed;
+} inference_context;
+
+static std::mutex contexts_mutex;
+static std::vector<inference_context *> contexts;
+// Bumped at destruction, so that threads drop the contexts of a previous model
+static int contexts_generation = 0;
+static thread_local inference_context *current_context = NULL;
+static thread_local int current_context_generation = -1;
+
+static inference_context *get_context(){
+    std::lock_guard<std::mutex> lock(contexts_mutex);
+    if (current_context == NULL || current_context_generation != contexts_generation){
+        // The calling threads are only pinned on request, otherwise their placement is given back once the buffers of
+        // the context are first touched on the NUMA node
+        thread_placement caller;
+        if (config.pin_callers)
+            configure_current_thread("inference", &config.conversion_cpus, 0);
+        else if (config.numa_node >= 0)
+            save_thread_placement(&caller);
+        if (config.numa_node >= 0)
+            prefer_numa_node(config.numa_node);
+        current_context = new inference_context();
+        allocate_output_tensors(&current_context->output_tensors, info);
+        // Room for the transposes of every input and output of the model
+        size_t arena_size = 0;
+        for (size_t i = 0; i < info->num_inputs; i++)
+            arena_size += info->inputs[i].size + TENSOR_ALIGNMENT;
+        for (size_t i = 0; i < info->num_outputs; i++)
+            arena_size += info->outputs[i].size + TENSOR_ALIGNMENT;
+        arena_init(&current_context->arena, arena_size);
+        if (config.numa_node >= 0 && current_context->arena.base != NULL)
+            memset(current_context->arena.base, 0, current_context->arena.capacity);
+        if (!config.pin_callers && config.numa_node >= 0)
+            restore_thread_placement(&caller);
+        current_context_generation = contexts_generation;
+        contexts.push_back(current_context);
+    }
+    return current_context;
+}
 
-static int model_id = 0;    // TODO: make it configurable
-static int stream_id = 0;   // TODO: make it configurable
+static void free_contexts(){
+    std::lock_guard<std::mutex> lock(contexts_mutex);
+    for (inference_context *context : contexts){
+        free_tensors_struct(&context->output_tensors);
+        arena_free(&context->arena);
+        delete context;
+    }
+    contexts.clear();
+    contexts_generation++;
+}
 
-static tensors_struct local_output_tensors;
-static io_info *info = NULL;
+// Transposes the tensors [begin, end) of the request of a context, into the buffers given by convert_inputs
+static void convert_input_tensors(void *job, size_t begin, size_t end){
+    inference_context *context = (inference_context *)job;
+    for (size_t i = begin; i < end; i++){
+        const conversion_plan *plan = context->input_plans[i];
+        if (plan != NULL && run_conversion_plan(plan, (const float *)context->input_tensors->data[i],
+                                                context->input_data[info->inputs[i].port]) != 0){
+            printf("Error: cannot transpose the input data\n");
+            context->conversion_failed = true;
+        }
+    }
+}
+
+static void convert_output_tensors(void *job, size_t begin, size_t end){
+    inference_context *context = (inference_context *)job;
+    for (size_t i = begin; i < end; i++){
+        if (context->output_destinations[i] != NULL &&
+            run_conversion_plan(output_plan(i), (const float *)context->output_tensors.data[i],
+                                context->output_destinations[i]) != 0){
+            printf("Error: cannot transpose the output data\n");
+            context->conversion_failed = true;
+        }
+    }
+}
+
+/**
+ * Run by the calling thread, or by the pipeline stages while the calling thread waits, with the conversion workers.
+ * The buffers of the transposes are taken from the arena of the context first, which only one thread may do.
+ */
+static int convert_inputs(void *job){
+    inference_context *context = (inference_context *)job;
+    tensors_struct *input_tensors = context->input_tensors;
+    size_t num_tensors = input_tensors->num_tensors;
+    double conversion_start = stats_now_us();
+    context->input_data.resize(num_tensors);
+    context->input_plans.resize(num_tensors);
+    context->fallback_plans.resize(num_tensors);
+    for (size_t i = 0; i < num_tensors; i++){
+        float *&data = context->input_data[info->inputs[i].port];
+        // The plans of the shapes already seen are found by their signature, only new shapes are checked
+        const conversion_plan *plan = find_input_plan(i, input_tensors->ranks[i], input_tensors->shapes[i],
+                                                      &context->fallback_plans[i]);
+        context->input_plans[i] = NULL;
+        if (plan->kind == CONVERSION_NONE){
+            data = (float *) input_tensors->data[i];
+            continue;
+        }
+        if (plan->kind == CONVERSION_INVALID){
+            printf("Error: cannot transpose the input data\n");
+            context->conversion_failed = true;
+            continue;
+        }
+        data = (float *)arena_alloc(&context->arena, plan->size);
+        if (data == NULL){
+            printf("Error: cannot allocate the transposed input data\n");
+            context->conversion_failed = true;
+            continue;
+        }
+        context->input_plans[i] = plan;
+    }
+    executor_parallel_for(num_tensors, 1, convert_input_tensors, context);
+    stats_record_stage(&stats, STAGE_INPUT_CONVERSION, stats_now_us() - conversion_start);
+    return context->conversion_failed ? RUNTIME_STATUS_ERROR : RUNTIME_STATUS_OK;
+}
+
+static int convert_outputs(void *job){
+    inference_context *context = (inference_context *)job;
+    tensors_struct &local_output_tensors = context->output_tensors;
+    size_t num_tensors = context->output_data.size();
+    double conversion_start = stats_now_us();
+    context->output_destinations.assign(num_tensors, NULL);
+    context->result_data.resize(num_tensors);
+    for (size_t i = 0; i < num_tensors; i++){
+        context->result_data[i] = local_output_tensors.data[i];
+        // The outputs that need no transpose are already in the device buffers, or in the buffers of the caller
+        if (output_plan(i)->kind == CONVERSION_NONE)
+            continue;
+        if (context->caller_outputs != NULL){
+            context->output_destinations[i] = (float *)context->caller_outputs[i];
+            continue;
+        }
+        context->output_destinations[i] = (float *)arena_alloc(&context->arena, info->outputs[i].size);
+        if (context->output_destinations[i] == NULL){
+            printf("Error: cannot allocate the transposed output data\n");
+            context->conversion_failed = true;
+            continue;
+        }
+        context->result_data[i] = context->output_destinations[i];
+    }
+    executor_parallel_for(num_tensors, 1, convert_output_tensors, context);
+    stats_record_stage(&stats, STAGE_OUTPUT_CONVERSION, stats_now_us() - conversion_start);
+    return context->conversion_failed ? RUNTIME_STATUS_ERROR : RUNTIME_STATUS_OK;
+}
+
+static int run_inference(tensors_struct *input_tensors, tensors_struct *output_tensors, void **caller_outputs,
+                         const inference_options *options, double call_us){
+    inference_context *context = get_context();
+    std::vector<float*> &input_data = context->input_data;
+    std::vector<float*> &output_data = context->output_data;
+    tensors_struct &local_output_tensors = context->output_tensors;
+
+    if (input_tensors->num_tensors != info->num_inputs){
+        printf("Error: the model has %zu inputs, %zu are given\n", info->num_inputs, input_tensors->num_tensors);
+        return RUNTIME_STATUS_INVALID_ARGUMENT;
+    }
+    // Check if all inputs are FLOATS
+    for (size_t i = 0; i < input_tensors->num_tensors; i++){
+        if (input_tensors->data_types[i] != DATA_TYPE_FLOAT){
+            printf("Error: input tensor data type is not FLOAT\n");
+            return RUNTIME_STATUS_INVALID_ARGUMENT;
+        }
+    }
+    // The outputs of the previous request of the thread are dropped now
+    arena_reset(&context->arena);
+    context->input_tensors = input_tensors;
+    context->caller_outputs = caller_outputs;
+    context->conversion_failed = false;
+
+    // The accelerator writes the outputs in the buffers of the caller directly, unless they are transposed on the way
+    output_data.resize(local_output_tensors.num_tensors);
+    for (size_t i = 0; i < local_output_tensors.num_tensors; i++){
+        const tensor_descriptor &output = info->outputs[i];
+        if (caller_outputs != NULL && !output.transposed)
+            output_data[output.port] = (float *)caller_outputs[i];
+        else
+            output_data[output.port] = (float *)local_output_tensors.data[i];
+    }
+
+    // Perform the inference on the accelerator, the conversions run in the calling thread or in the pipeline stages
+    request_conversions conversions = {convert_inputs, convert_outputs, context};
+    int exit_code = scheduler_submit(input_data, output_data, &conversions, options, call_us);
+
+    // The transposed inputs stay in the arena until its next reset
+    input_data.clear();
+    if (exit_code != RUNTIME_STATUS_OK){
+        if (exit_code == RUNTIME_STATUS_DEVICE_ERROR)
+            printf("Error: the inference on the accelerator failed\n");
+        return exit_code;
+    }
+
+    if (output_tensors != NULL){
+        *output_tensors = local_output_tensors;
+        output_tensors->data = context->result_data.data();
+    }
+
+    return RUNTIME_STATUS_OK;
+}
+
+/**
+ * MxAccl creates its input and output workers when the model is opened and started, and they inherit the CPUs and
+ * the memory policy of the loading thread: the loading thread takes the placement of the workers in the meantime.
+ */
+static void enter_accl_placement(thread_placement *loading){
+    save_thread_placement(loading);
+    if (CPU_COUNT(&config.accl_cpus) > 0)
+        configure_current_thread("loading", &config.accl_cpus, 0);
+    if (config.numa_node >= 0)
+        prefer_numa_node(config.numa_node);
+}
+
+static void leave_accl_placement(thread_placement *loading){
+    restore_thread_placement(loading);
+}
+
+/**
+ * Push synthetic zero inputs shaped from the io_info structure through the whole inference path,
+ * so that buffers are faulted in and the driver queues are filled before the first caller request.
+ */
+static int run_warmup(int iterations){
+    printf("Warming up with %d inferences\n", iterations);
+    tensors_struct synthetic_inputs;
+    tensors_struct synthetic_outputs;
+    allocate_synthetic_input_tensors(&synthetic_inputs, info);
+
+    int exit_code = 0;
+    for (int i = 0; i < iterations && exit_code == 0; i++){
+        double start = stats_now_us();
+        exit_code = run_inference(&synthetic_inputs, &synthetic_outputs, NULL, &default_options, stats_now_us());
+        if (exit_code == 0)
+            stats_record_warmup(&stats, stats_now_us() - start);
+    }
+
+    free_tensors_struct(&synthetic_inputs);
+    return exit_code;
+}
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,135 +290,260 @@ extern "C" {
 
 int runtime_initialization_with_args(int length, const char **keys, const void **values){
     printf("Initialization with %d arguments.\n", length);
-    
-    // Look for an argument with the key "json"
+    config = default_runtime_config();
+
+    // Look for an argument with the key "json", the other ones configure the runtime
     for (int i = 0; i < length; i++){
         if (strcmp(keys[i], "json") == 0){
+            if (info != NULL)
+                continue;
             const char *json = (const char *)values[i];
             info = initialize_io_info(json);
             if (info == NULL){
                 printf("Error: cannot initialize the io_info structure\n");
-                return 1;
+                return RUNTIME_STATUS_ERROR;
             }
-            break;
+            continue;
         }
+        int exit_code = parse_runtime_argument(&config, keys[i], (const char *)values[i]);
+        if (exit_code > 0)
+            return RUNTIME_STATUS_ERROR;
+        if (exit_code < 0)
+            printf("Warning: ignoring unknown argument `%s`\n", keys[i]);
     }
 
     if (info == NULL){
         printf("Error: cannot find the JSON argument\n");
-        return 1;
+        return RUNTIME_STATUS_ERROR;
     }
 
 #ifdef DEBUG
     print_io_info(info);
+    print_runtime_config(&config);
 #endif
 
-    return 0;
+    return RUNTIME_STATUS_OK;
 }
 
 int runtime_initialization(){
-    return 0;
+    return RUNTIME_STATUS_OK;
+}
+
+// Stops the runtime threads and frees what the model loading allocated, the io_info excepted, whatever step it reached
+static void unload_model(){
+    controller_stop();
+    scheduler_stop();
+    executor_stop();
+    free_contexts();
+    results_free();
+    plans_free();
+    memory_trim();
+    device_close();
 }
 
 int runtime_model_loading(const char *file_path){
     printf("Loading model: `%s`\n", file_path);
+    double start = stats_now_us();
+    if (resolve_runtime_placement(&config) != 0)
+        return RUNTIME_STATUS_ERROR;
+    memory_set_huge_pages(config.huge_pages);
+    // Before the plans, which keep the kernels chosen when they are compiled
+    if (set_conversion_isa(config.conversion_isa) != 0)
+        return RUNTIME_STATUS_ERROR;
+    printf("Conversion kernels: %s\n", active_conversion_kernels()->name);
+
+    thread_placement loading;
+    enter_accl_placement(&loading);
+    if (config.autotune && tune_runtime(file_path, &config) != 0)
+        printf("Warning: the auto-tuning failed, loading the model with the given settings\n");
+    if (device_open(file_path, &config, &model_info) != 0){
+        leave_accl_placement(&loading);
+        printf("Error: cannot load the model\n");
+        device_close();
+        return RUNTIME_STATUS_ERROR;
+    }
 
-    accl = new MX::Runtime::MxAccl(file_path);
-    model_info = accl->get_model_info(model_id);
-
-    // Allocate output tensors
+    // Fall back to the model information when no JSON was given
     if(info == NULL)
         info = initialize_io_info_from_model_info(model_info);
-
-    allocate_output_tensors(&local_output_tensors, info);
+    if (info == NULL){
+        leave_accl_placement(&loading);
+        printf("Error: cannot initialize the io_info structure\n");
+        device_close();
+        return RUNTIME_STATUS_ERROR;
+    }
+    bind_io_info(info, model_info);
+    // The conversions of the shapes of the io_info are checked once, here
+    if (plans_build(info, model_info) != 0){
+        leave_accl_placement(&loading);
+        printf("Error: cannot build the conversion plans\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
+    }
 
     // Debug IO information
 #ifdef DEBUG
     print_model_info(model_info);
 #endif
 
-    accl->start(true);
+    reset_runtime_stats(&stats);
+    int exit_code = device_start();
+    leave_accl_placement(&loading);
+    if (exit_code != 0){
+        printf("Error: cannot start the accelerator\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
+    }
+    stats_record_device_settings(&stats, device_applied_settings());
 
-    return 0;
-}
+    if (results_allocate(info, config.result_slots) != 0){
+        printf("Error: cannot allocate the result slots\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
+    }
 
-int runtime_inference_execution(tensors_struct *input_tensors, tensors_struct *output_tensors){
-    printf("Inference\n");
-    // Check if all inputs are FLOATS
-    for (size_t i = 0; i < input_tensors->num_tensors; i++){
-        if (input_tensors->data_types[i] != DATA_TYPE_FLOAT){
-            printf("Error: input tensor data type is not FLOAT\n");
-            return 3;
-        }
+    if (executor_start(config.conversion_threads, &config.conversion_cpus, config.numa_node, config.spin_us) != 0){
+        printf("Error: cannot start the conversion workers\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
     }
-    for (size_t i = 0; i < input_tensors->num_tensors; i++){
-        if(input_needs_transpose(i, model_info, input_tensors)){
-            float *transposed_data = transpose_input_data(i, input_tensors);
-            if (transposed_data == NULL){
-                printf("Error: cannot transpose the input data\n");
-                return 1;
-            }
-            input_data.push_back(transposed_data);
-            input_transposed.push_back(true);
-        } else {
-            input_data.push_back((float *) input_tensors->data[i]);
-            input_transposed.push_back(false);
-        }
+
+    if (scheduler_start(&config, &stats) != 0){
+        printf("Error: cannot start the host-side queue\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
+    }
+
+    if (config.warmup_iterations > 0 && run_warmup(config.warmup_iterations) != 0){
+        printf("Error: the warm-up failed\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
     }
+    stats_record_model_loading(&stats, stats_now_us() - start);
+
+    if (controller_start(&config, &stats) != 0){
+        printf("Error: cannot start the adaptive controller\n");
+        unload_model();
+        return RUNTIME_STATUS_ERROR;
+    }
+
+    return RUNTIME_STATUS_OK;
+}
+
+int runtime_inference_execution(tensors_struct *input_tensors, tensors_struct *output_tensors){
+    return runtime_inference_execution_with_options(input_tensors, output_tensors, NULL);
+}
 
-    for (size_t i = 0; i < local_output_tensors.num_tensors; i++)
-        output_data.push_back((float *)local_output_tensors.data[i]);
+int runtime_inference_execution_with_options(tensors_struct *input_tensors, tensors_struct *output_tensors, const inference_options *options){
+#ifdef DEBUG
+    printf("Inference\n");
+#endif
+    if (options == NULL)
+        options = &default_options;
+    double start = stats_now_us();
+    int exit_code = run_inference(input_tensors, output_tensors, NULL, options, start);
+    if (exit_code == 0)
+        stats_record_inference(&stats, stats_now_us() - start);
+    return exit_code;
+}
 
-    // Perform the inference on the accelerator
-    accl->send_input(input_data, model_id, stream_id, false);
-    accl->receive_output(output_data, model_id, stream_id, false);
+size_t runtime_num_outputs(){
+    return info == NULL ? 0 : info->num_outputs;
+}
 
-    // Free the input data
-    for (size_t i = 0; i < input_data.size(); i++){
-        if (input_transposed[i])
-            free(input_data[i]);
+int runtime_output_layout(size_t index, tensor_layout *layout){
+    if (info == NULL || index >= info->num_outputs){
+        printf("Error: no output %zu in the loaded model\n", index);
+        return RUNTIME_STATUS_INVALID_ARGUMENT;
     }
+    const tensor_descriptor &output = info->outputs[index];
+    layout->name = output.name;
+    layout->data_type = output.data_type;
+    layout->rank = output.rank;
+    layout->shape = output.shape;
+    layout->size = output.size;
+    return RUNTIME_STATUS_OK;
+}
 
-    // Transpose the output data if needed
-    for (size_t i = 0; i < output_data.size(); i++){
-        if(output_needs_transpose(i, model_info, &local_output_tensors)){
-            float *transposed_data = transpose_output_data(i, &local_output_tensors );
-            if (transposed_data == NULL){
-                printf("Error: cannot transpose the output data\n");
-                return 1;
-            }
-            // Free the original output data
-            free(local_output_tensors.data[i]);
-            // Point to the transposed data
-            local_output_tensors.data[i] = (void *)transposed_data;
+int runtime_inference_execution_into(tensors_struct *input_tensors, void **output_buffers, const size_t *buffer_sizes, const inference_options *options){
+    if (options == NULL)
+        options = &default_options;
+    for (size_t i = 0; i < runtime_num_outputs(); i++){
+        tensor_layout layout;
+        runtime_output_layout(i, &layout);
+        if (output_buffers[i] == NULL || buffer_sizes[i] < layout.size){
+            printf("Error: the buffer of the output `%s` holds %zu bytes, %zu are needed\n", layout.name,
+                   output_buffers[i] == NULL ? 0 : buffer_sizes[i], layout.size);
+            return RUNTIME_STATUS_INVALID_ARGUMENT;
         }
     }
+    double start = stats_now_us();
+    int exit_code = run_inference(input_tensors, NULL, output_buffers, options, start);
+    if (exit_code == 0)
+        stats_record_inference(&stats, stats_now_us() - start);
+    return exit_code;
+}
 
-    input_transposed.clear();
-    input_data.clear();
+int runtime_inference_execution_view(tensors_struct *input_tensors, result_view *view, const inference_options *options){
+    if (options == NULL)
+        options = &default_options;
+    unsigned generation;
+    int slot = results_acquire(&generation);
+    if (slot < 0){
+        printf("Error: all %d result slots are held, release one first\n", config.result_slots);
+        return RUNTIME_STATUS_NO_RESULT_SLOT;
+    }
+    tensors_struct *outputs = results_tensors(slot);
+    double start = stats_now_us();
+    int exit_code = run_inference(input_tensors, NULL, outputs->data, options, start);
+    if (exit_code != 0){
+        results_release(slot, generation);
+        return exit_code;
+    }
+    stats_record_inference(&stats, stats_now_us() - start);
+    view->outputs = outputs;
+    view->slot = slot;
+    view->generation = generation;
+    return RUNTIME_STATUS_OK;
+}
 
-    *output_tensors = local_output_tensors;
+int runtime_result_release(const result_view *view){
+    if (results_release(view->slot, view->generation) != 0)
+        return RUNTIME_STATUS_INVALID_ARGUMENT;
+    return RUNTIME_STATUS_OK;
+}
 
-    return 0;
+int runtime_inference_cancel(unsigned long long tag){
+    return scheduler_cancel(tag);
 }
 
 int runtime_inference_cleanup(){
     printf("Cleanup\n");
 
-    output_data.clear();
+    std::lock_guard<std::mutex> lock(contexts_mutex);
+    if (current_context != NULL && current_context_generation == contexts_generation){
+        current_context->output_data.clear();
+        arena_reset(&current_context->arena);
+    }
 
-    return 0;
+    return RUNTIME_STATUS_OK;
 }
 
 int runtime_destruction(){
     printf("Destruction\n");
 
-    free_tensors_struct(&local_output_tensors);
-    runtime_inference_cleanup();
+    controller_stop();
+    scheduler_stop();
+    executor_stop();
+    print_runtime_stats(&stats);
+    size_t total_bytes, huge_page_bytes;
+    memory_usage(&total_bytes, &huge_page_bytes);
+    printf("Tensor buffers: %.1f MB, %.1f MB mapped for huge pages\n", total_bytes / 1e6, huge_page_bytes / 1e6);
+    unload_model();
     free_io_info(info);
-    delete accl;
+    info = NULL;
 
-    return 0;
+    return RUNTIME_STATUS_OK;
 }
 
 const char *runtime_error_message() {
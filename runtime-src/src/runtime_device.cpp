@@ -0,0 +1,191 @@
+#include "runtime_device.hpp"
+#include "runtime_dfp.hpp"
+#include "runtime_stats.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#ifdef SIMULATED_DEVICE
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#endif
+
+static MX::Runtime::MxAccl *accl = NULL;
+
+static int model_id = 0;    // TODO: make it configurable
+static int stream_id = 0;   // TODO: make it configurable
+static int group_id = 0;    // TODO: make it configurable
+
+static device_settings requested_settings = {0, 0};
+static device_settings applied_settings = {0, 0};
+
+#ifdef SIMULATED_DEVICE
+// DFP read for the simulated accelerator
+static Dfp::DfpObject *dfp = NULL;
+
+// Simulated accelerator, without the device: one frame at a time, `simulated_us` each
+static int simulated_us = 0;
+static std::mutex simulated_mutex;
+// end times of the frames sent and not received yet, in order
+static std::deque<double> simulated_ends_us;
+static double simulated_free_us = 0;
+static std::vector<size_t> simulated_output_sizes;
+
+/**
+ * Read the ports of the model from the DFP, without opening the device. The data formats are not simulated, the
+ * outputs are zeros.
+ */
+static int simulated_open(const char *file_path, MX::Types::MxModelInfo *model_info){
+    dfp = new Dfp::DfpObject(file_path);
+    if (!dfp->valid){
+        printf("Error: invalid DFP file `%s`\n", file_path);
+        return 1;
+    }
+    Dfp::DfpMeta meta = dfp->get_dfp_meta();
+    if (meta.num_models <= model_id){
+        printf("Error: the DFP has no model %d\n", model_id);
+        return 1;
+    }
+    model_info->model_index = model_id;
+    model_info->num_in_featuremaps = meta.model_inports[model_id].size();
+    model_info->num_out_featuremaps = meta.model_outports[model_id].size();
+    for (uint8_t port : meta.model_inports[model_id]){
+        Dfp::PortInfo *port_info = dfp->input_port(port);
+        if (port_info == NULL){
+            printf("Error: cannot get the shape of the input port %d\n", port);
+            return 1;
+        }
+        model_info->input_layer_names.push_back(port_info->layer_name);
+        model_info->in_featuremap_shapes.push_back(MX::Types::ShapeVector(port_info->dim_h, port_info->dim_w, port_info->dim_z, port_info->dim_c));
+        model_info->in_featuremap_sizes.push_back((size_t) port_info->dim_h * port_info->dim_w * port_info->dim_z * port_info->dim_c);
+    }
+    for (uint8_t port : meta.model_outports[model_id]){
+        Dfp::PortInfo *port_info = dfp->output_port(port);
+        if (port_info == NULL){
+            printf("Error: cannot get the shape of the output port %d\n", port);
+            return 1;
+        }
+        size_t size = (size_t) port_info->dim_h * port_info->dim_w * port_info->dim_z * port_info->dim_c;
+        model_info->output_layer_names.push_back(port_info->layer_name);
+        model_info->out_featuremap_shapes.push_back(MX::Types::ShapeVector(port_info->dim_h, port_info->dim_w, port_info->dim_z, port_info->dim_c));
+        model_info->out_featuremap_sizes.push_back(size);
+        simulated_output_sizes.push_back(size);
+    }
+    simulated_ends_us.clear();
+    simulated_free_us = 0;
+    printf("Simulating the accelerator, %d us per frame\n", simulated_us);
+    return 0;
+}
+
+static int simulated_send(){
+    std::lock_guard<std::mutex> lock(simulated_mutex);
+    simulated_free_us = std::max(simulated_free_us, stats_now_us()) + simulated_us;
+    simulated_ends_us.push_back(simulated_free_us);
+    return 0;
+}
+
+static int simulated_receive(std::vector<float*> &output_data){
+    double end_us;
+    {
+        std::lock_guard<std::mutex> lock(simulated_mutex);
+        if (simulated_ends_us.empty()){
+            printf("Error: no frame was sent to the simulated accelerator\n");
+            return 1;
+        }
+        end_us = simulated_ends_us.front();
+        simulated_ends_us.pop_front();
+    }
+    double wait_us = end_us - stats_now_us();
+    if (wait_us > 0)
+        std::this_thread::sleep_for(std::chrono::duration<double, std::micro>(wait_us));
+    for (size_t i = 0; i < simulated_output_sizes.size() && i < output_data.size(); i++)
+        memset(output_data[i], 0, simulated_output_sizes[i] * sizeof(float));
+    return 0;
+}
+#endif
+
+int device_open(const char *file_path, runtime_config *config, MX::Types::MxModelInfo *model_info){
+    requested_settings = config->device;
+    applied_settings = device_settings{0, 0};
+    if (config->keep_weights_resident){
+        // A record kept on the host can outlive the weights it names, only the device could tell which ones it holds
+        printf("Error: keep_weights_resident is not supported, the driver cannot report the weights held by the device\n");
+        return 1;
+    }
+    if (dfp_prefetch(file_path) != 0)
+        return 1;
+#ifdef SIMULATED_DEVICE
+    simulated_us = config->simulated_device_us;
+    if (simulated_us > 0)
+        return simulated_open(file_path, model_info);
+#else
+    if (config->simulated_device_us > 0){
+        printf("Error: simulated_device_us needs a runtime built with the SIMULATED_DEVICE option\n");
+        return 1;
+    }
+#endif
+
+    accl = new MX::Runtime::MxAccl(file_path, group_id);
+    *model_info = accl->get_model_info(model_id);
+    return 0;
+}
+
+int device_start(){
+#ifdef SIMULATED_DEVICE
+    if (simulated_us > 0)
+        return 0;
+#endif
+    if (accl == NULL)
+        return 0;
+    const device_settings &settings = requested_settings;
+    if (settings.input_workers > 0 || settings.output_workers > 0){
+        // The vendor default is one worker per stream, and a single stream is used
+        int input_workers = settings.input_workers > 0 ? settings.input_workers : 1;
+        int output_workers = settings.output_workers > 0 ? settings.output_workers : 1;
+        accl->set_num_workers(input_workers, output_workers, model_id);
+        applied_settings.input_workers = input_workers;
+        applied_settings.output_workers = output_workers;
+    }
+    accl->start(true);
+    return 0;
+}
+
+int device_send(std::vector<float*> &input_data){
+#ifdef SIMULATED_DEVICE
+    if (simulated_us > 0)
+        return simulated_send();
+#endif
+    accl->send_input(input_data, model_id, stream_id, false);
+    return 0;
+}
+
+int device_receive(std::vector<float*> &output_data){
+#ifdef SIMULATED_DEVICE
+    if (simulated_us > 0)
+        return simulated_receive(output_data);
+#endif
+    int received_stream_id = stream_id;
+    accl->receive_output(output_data, model_id, received_stream_id, false);
+    return 0;
+}
+
+void device_close(){
+    if (accl != NULL){
+        delete accl;
+        accl = NULL;
+    }
+#ifdef SIMULATED_DEVICE
+    simulated_output_sizes.clear();
+    simulated_ends_us.clear();
+    if (dfp != NULL){
+        delete dfp;
+        dfp = NULL;
+    }
+#endif
+}
+
+device_settings device_applied_settings(){
+    return applied_settings;
+}
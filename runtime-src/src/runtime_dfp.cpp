@@ -0,0 +1,188 @@
+#include "runtime_dfp.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+
+#define FINGERPRINT_CACHE "/var/tmp/mxa_dfp_fingerprints"
+#define FINGERPRINT_CACHE_ENTRIES 64
+#define FINGERPRINT_READ_SIZE (1 << 20)
+
+// What a cached fingerprint is valid for
+typedef struct fingerprint_key {
+    char path[PATH_MAX];
+    long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+} fingerprint_key;
+
+// FNV-1a over 64-bit words, followed by a final avalanche
+static uint64_t fingerprint_update(uint64_t hash, const uint8_t *data, size_t length){
+    const uint64_t prime = 0x100000001b3ULL;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8){
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < length; i++)
+        hash = (hash ^ data[i]) * prime;
+    return hash;
+}
+
+static uint64_t fingerprint_final(uint64_t hash, uint64_t length){
+    hash ^= length;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static int hash_file(int fd, uint64_t *fingerprint){
+    std::vector<uint8_t> buffer(FINGERPRINT_READ_SIZE);
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t length = 0;
+    // Whole words only until the end of the file, so that the hash does not depend on the read sizes
+    size_t pending = 0;
+    while (true){
+        ssize_t count = read(fd, buffer.data() + pending, buffer.size() - pending);
+        if (count < 0)
+            return 1;
+        if (count == 0)
+            break;
+        length += count;
+        size_t available = pending + count;
+        size_t words = available & ~(size_t)7;
+        hash = fingerprint_update(hash, buffer.data(), words);
+        pending = available - words;
+        memmove(buffer.data(), buffer.data() + words, pending);
+    }
+    hash = fingerprint_update(hash, buffer.data(), pending);
+    *fingerprint = fingerprint_final(hash, length);
+    return 0;
+}
+
+static void format_key(const fingerprint_key *key, char *prefix, size_t length){
+    snprintf(prefix, length, "%lld %lld.%09ld %s\n", key->size, key->mtime_sec, key->mtime_nsec, key->path);
+}
+
+static int read_cached_fingerprint(const fingerprint_key *key, uint64_t *fingerprint){
+    FILE *fp = fopen(FINGERPRINT_CACHE, "r");
+    if (!fp)
+        return 1;
+    char expected[PATH_MAX + 64];
+    format_key(key, expected, sizeof(expected));
+    char line[PATH_MAX + 64];
+    int found = 1;
+    while (found != 0 && fgets(line, sizeof(line), fp) != NULL){
+        // The fingerprint comes first, the key is the rest of the line
+        char *end = NULL;
+        uint64_t entry = strtoull(line, &end, 16);
+        if (end == line + 16 && *end == ' ' && strcmp(end + 1, expected) == 0){
+            *fingerprint = entry;
+            found = 0;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static void write_cached_fingerprint(const fingerprint_key *key, uint64_t fingerprint){
+    // Keep the entries of the other files, the most recent ones last
+    char entry[PATH_MAX + 64];
+    format_key(key, entry, sizeof(entry));
+    std::string path_suffix = std::string(" ") + key->path + "\n";
+    std::vector<std::string> lines;
+    FILE *fp = fopen(FINGERPRINT_CACHE, "r");
+    if (fp){
+        char line[PATH_MAX + 64];
+        while (fgets(line, sizeof(line), fp) != NULL){
+            size_t length = strlen(line);
+            if (length < path_suffix.size() || strcmp(line + length - path_suffix.size(), path_suffix.c_str()) != 0)
+                lines.push_back(line);
+        }
+        fclose(fp);
+    }
+    if (lines.size() >= FINGERPRINT_CACHE_ENTRIES)
+        lines.erase(lines.begin(), lines.end() - (FINGERPRINT_CACHE_ENTRIES - 1));
+
+    // Replace the cache at once, from a file of its own, so that concurrent loads never see a partial one
+    std::string tmp_path = std::string(FINGERPRINT_CACHE) + ".XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0)
+        return;
+    // mkstemp creates the file for its owner only, the cache is shared
+    fchmod(fd, 0644);
+    fp = fdopen(fd, "w");
+    if (!fp){
+        close(fd);
+        remove(tmp_path.c_str());
+        return;
+    }
+    for (std::string &line : lines)
+        fputs(line.c_str(), fp);
+    fprintf(fp, "%016" PRIx64 " %s", fingerprint, entry);
+    fclose(fp);
+    if (rename(tmp_path.c_str(), FINGERPRINT_CACHE) != 0)
+        remove(tmp_path.c_str());
+}
+
+int dfp_prefetch(const char *file_path){
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        printf("Error: cannot open the DFP file `%s`\n", file_path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0){
+        printf("Error: the DFP file `%s` is empty\n", file_path);
+        close(fd);
+        return 1;
+    }
+    // Start reading the whole file in the background, the pages stay in the page cache after the close
+    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
+    close(fd);
+    return 0;
+}
+
+int dfp_fingerprint(const char *file_path, uint64_t *fingerprint){
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        printf("Error: cannot open the DFP file `%s`\n", file_path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0){
+        printf("Error: the DFP file `%s` is empty\n", file_path);
+        close(fd);
+        return 1;
+    }
+    fingerprint_key key;
+    // The same file is found from any working directory, and a path with a line break is never cached
+    bool cacheable = realpath(file_path, key.path) != NULL && strchr(key.path, '\n') == NULL;
+    key.size = st.st_size;
+    key.mtime_sec = st.st_mtim.tv_sec;
+    key.mtime_nsec = st.st_mtim.tv_nsec;
+    if (cacheable && read_cached_fingerprint(&key, fingerprint) == 0){
+        close(fd);
+        return 0;
+    }
+
+    int exit_code = hash_file(fd, fingerprint);
+    close(fd);
+    if (exit_code != 0){
+        printf("Error: cannot read the DFP file `%s`\n", file_path);
+        return 1;
+    }
+    if (cacheable)
+        write_cached_fingerprint(&key, *fingerprint);
+    return 0;
+}
@@ -0,0 +1,259 @@
+#include "runtime_executor.hpp"
+#include "runtime_ring.hpp"
+#include "runtime_threads.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#define EXECUTOR_DEQUE_CAPACITY 256
+#define INJECTION_RING_CAPACITY 1024
+
+typedef struct executor_task {
+    range_function function;
+    void *arg;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    // iterations of the loop not run yet, on the stack of its calling thread
+    std::atomic<size_t> *remaining;
+} executor_task;
+
+// Taken from the bottom by its owner, and from the top by the thieves, under a spin lock held for a few stores
+typedef struct alignas(CACHE_LINE_SIZE) worker_deque {
+    std::atomic_flag lock;
+    size_t top;
+    size_t bottom;
+    executor_task tasks[EXECUTOR_DEQUE_CAPACITY];
+} worker_deque;
+
+static std::vector<std::thread> workers;
+static worker_deque *deques = NULL;
+static int num_workers = 0;
+// Workers taking tasks, the others are parked until the adaptive controller wants them back
+static std::atomic<int> active_workers(0);
+static std::atomic_bool stopping(false);
+static cpu_set_t worker_cpus;
+static int worker_numa_node = -1;
+static double worker_spin_us = 0;
+
+// Loops offered by the threads that are not workers
+static mpmc_ring<executor_task> injection_ring(INJECTION_RING_CAPACITY);
+// Tasks in the deques and in the injection ring, transiently negative
+static std::atomic<long> num_available(0);
+static wait_point work_event;
+static wait_point done_event;
+static wait_point park_event;
+
+static thread_local int current_worker = -1;
+static thread_local uint32_t steal_seed = 0;
+
+static void lock_deque(worker_deque *deque){
+    while (deque->lock.test_and_set(std::memory_order_acquire))
+        cpu_relax();
+}
+
+static void unlock_deque(worker_deque *deque){
+    deque->lock.clear(std::memory_order_release);
+}
+
+static bool push_bottom(worker_deque *deque, const executor_task &task){
+    lock_deque(deque);
+    bool pushed = deque->bottom - deque->top < EXECUTOR_DEQUE_CAPACITY;
+    if (pushed){
+        deque->tasks[deque->bottom % EXECUTOR_DEQUE_CAPACITY] = task;
+        deque->bottom++;
+        num_available++;
+    }
+    unlock_deque(deque);
+    if (pushed)
+        work_event.notify();
+    return pushed;
+}
+
+static bool pop_bottom(worker_deque *deque, executor_task &task){
+    lock_deque(deque);
+    bool popped = deque->bottom != deque->top;
+    if (popped){
+        deque->bottom--;
+        task = deque->tasks[deque->bottom % EXECUTOR_DEQUE_CAPACITY];
+        num_available--;
+    }
+    unlock_deque(deque);
+    return popped;
+}
+
+static bool steal_top(worker_deque *deque, executor_task &task){
+    // A busy victim is skipped rather than waited for
+    if (deque->lock.test_and_set(std::memory_order_acquire))
+        return false;
+    bool stolen = deque->bottom != deque->top;
+    if (stolen){
+        task = deque->tasks[deque->top % EXECUTOR_DEQUE_CAPACITY];
+        deque->top++;
+        num_available--;
+    }
+    unlock_deque(deque);
+    return stolen;
+}
+
+static bool find_task(executor_task &task){
+    if (current_worker >= 0 && pop_bottom(&deques[current_worker], task))
+        return true;
+    if (injection_ring.try_pop(task)){
+        num_available--;
+        return true;
+    }
+    if (num_available <= 0)
+        return false;
+    // Start from a random victim, so that the thieves spread over the workers
+    if (steal_seed == 0)
+        steal_seed = 2654435761u * (uint32_t)(current_worker + 2);
+    steal_seed ^= steal_seed << 13;
+    steal_seed ^= steal_seed >> 17;
+    steal_seed ^= steal_seed << 5;
+    for (int i = 0; i < num_workers; i++){
+        int victim = (steal_seed + i) % num_workers;
+        if (victim != current_worker && steal_top(&deques[victim], task))
+            return true;
+    }
+    return false;
+}
+
+static void run_task(executor_task task){
+    // Leave the upper halves to the thieves while the range is worth splitting
+    if (current_worker >= 0){
+        while (task.end - task.begin > task.grain){
+            executor_task upper = task;
+            upper.begin = task.begin + (task.end - task.begin) / 2;
+            if (!push_bottom(&deques[current_worker], upper))
+                break;
+            task.end = upper.begin;
+        }
+    }
+    task.function(task.arg, task.begin, task.end);
+    size_t done = task.end - task.begin;
+    if (task.remaining->fetch_sub(done, std::memory_order_acq_rel) == done)
+        done_event.notify();
+}
+
+static void worker_loop(int index){
+    current_worker = index;
+    configure_current_thread("conversion", &worker_cpus, 0);
+    if (worker_numa_node >= 0)
+        prefer_numa_node(worker_numa_node);
+    while (true){
+        executor_task task;
+        if (index >= active_workers.load(std::memory_order_relaxed)){
+            // Hand over the halves left on the deque before parking
+            if (pop_bottom(&deques[index], task)){
+                run_task(task);
+                continue;
+            }
+            park_event.wait([index]{ return index < active_workers.load() || stopping; }, 0);
+            if (stopping)
+                break;
+            continue;
+        }
+        if (find_task(task)){
+            run_task(task);
+            continue;
+        }
+        if (stopping)
+            break;
+        work_event.wait([index]{ return num_available > 0 || stopping || index >= active_workers.load(); }, worker_spin_us);
+    }
+}
+
+int executor_start(int count, const cpu_set_t *cpus, int numa_node, int spin_us){
+    if (num_workers > 0){
+        printf("Error: the conversion workers are already started\n");
+        return 1;
+    }
+    if (count <= 0)
+        return 0;
+    worker_cpus = *cpus;
+    worker_numa_node = numa_node;
+    worker_spin_us = spin_us;
+    stopping = false;
+    num_available = 0;
+    deques = new worker_deque[count];
+    for (int i = 0; i < count; i++){
+        deques[i].lock.clear();
+        deques[i].top = 0;
+        deques[i].bottom = 0;
+    }
+    num_workers = count;
+    active_workers = count;
+    for (int i = 0; i < count; i++)
+        workers.push_back(std::thread(worker_loop, i));
+    return 0;
+}
+
+void executor_stop(){
+    if (num_workers == 0)
+        return;
+    stopping = true;
+    work_event.notify();
+    park_event.notify();
+    for (std::thread &worker : workers)
+        worker.join();
+    workers.clear();
+    num_workers = 0;
+    active_workers = 0;
+    delete[] deques;
+    deques = NULL;
+}
+
+int executor_num_workers(){
+    return num_workers;
+}
+
+void executor_set_active_workers(int count){
+    active_workers = std::max(0, std::min(count, num_workers));
+    // The parked workers wake up to take tasks again, and the active ones to park
+    park_event.notify();
+    work_event.notify();
+}
+
+int executor_active_workers(){
+    return active_workers.load(std::memory_order_relaxed);
+}
+
+void executor_parallel_for(size_t count, size_t grain, range_function function, void *arg){
+    grain = std::max<size_t>(1, grain);
+    int num_active = active_workers.load(std::memory_order_relaxed);
+    if (num_active == 0 || count <= grain){
+        function(arg, 0, count);
+        return;
+    }
+    std::atomic<size_t> remaining(count);
+    // One part per thread, the calling thread keeps the first one
+    size_t parts = std::min<size_t>(num_active + 1, (count + grain - 1) / grain);
+    executor_task first = {function, arg, 0, count / parts, grain, &remaining};
+    for (size_t i = 1; i < parts; i++){
+        executor_task task = {function, arg, count * i / parts, count * (i + 1) / parts, grain, &remaining};
+        if (current_worker >= 0 && push_bottom(&deques[current_worker], task))
+            continue;
+        num_available++;
+        if (injection_ring.try_push(task)){
+            work_event.notify();
+        } else {
+            num_available--;
+            run_task(task);
+        }
+    }
+    run_task(first);
+
+    // Help with the tasks left rather than sleeping
+    while (remaining.load(std::memory_order_acquire) > 0){
+        executor_task task;
+        if (find_task(task))
+            run_task(task);
+        else
+            done_event.wait([&remaining]{ return remaining.load(std::memory_order_acquire) == 0; }, worker_spin_us);
+    }
+}
@@ -1,7 +1,105 @@
 #include "runtime_ioinfo.hpp"
+#include "runtime_plan.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// A tensor as read from the JSON or the model, before it is packed
+typedef struct tensor_spec {
+    std::string name;
+    std::vector<size_t> shape;
+    tensor_data_type data_type;
+} tensor_spec;
+
+static size_t align_up(size_t size, size_t alignment){
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+static void describe_tensor(const tensor_spec &spec, int index, tensor_descriptor *descriptor, size_t **dimensions,
+                            char **names){
+    size_t rank = spec.shape.size();
+    size_t *shape = *dimensions;
+    size_t *strides = shape + rank;
+    *dimensions += 2 * rank;
+    size_t stride = 1;
+    for (size_t i = rank; i-- > 0;){
+        shape[i] = spec.shape[i];
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+    memcpy(*names, spec.name.c_str(), spec.name.size() + 1);
+    descriptor->name = *names;
+    *names += spec.name.size() + 1;
+    descriptor->shape = shape;
+    descriptor->strides = strides;
+    descriptor->rank = rank;
+    descriptor->num_elements = stride;
+    // TODO: support other data types, the tensors are converted to float
+    descriptor->size = stride * sizeof(float);
+    descriptor->data_type = spec.data_type;
+    descriptor->port = index;
+    descriptor->transposed = false;
+}
+
+/**
+ * Pack the tensors in one allocation: the header, the descriptors of the inputs then of the outputs, their shapes and
+ * strides, and their names.
+ */
+static io_info *build_io_info(const std::vector<tensor_spec> &inputs, const std::vector<tensor_spec> &outputs){
+    size_t num_tensors = inputs.size() + outputs.size();
+    size_t num_dimensions = 0;
+    size_t names_size = 0;
+    for (const std::vector<tensor_spec> *specs : {&inputs, &outputs}){
+        for (const tensor_spec &spec : *specs){
+            num_dimensions += 2 * spec.shape.size();
+            names_size += spec.name.size() + 1;
+        }
+    }
+    size_t header_size = align_up(sizeof(io_info), alignof(tensor_descriptor));
+    size_t descriptors_size = num_tensors * sizeof(tensor_descriptor);
+    size_t size = align_up(header_size + descriptors_size + num_dimensions * sizeof(size_t) + names_size,
+                           alignof(tensor_descriptor));
+    char *block = (char *)aligned_alloc(alignof(tensor_descriptor), size);
+    if (block == NULL)
+        return NULL;
+
+    io_info *info = (io_info *)block;
+    tensor_descriptor *descriptors = (tensor_descriptor *)(block + header_size);
+    size_t *dimensions = (size_t *)(block + header_size + descriptors_size);
+    char *names = (char *)(dimensions + num_dimensions);
+    info->num_inputs = inputs.size();
+    info->num_outputs = outputs.size();
+    info->inputs = descriptors;
+    info->outputs = descriptors + inputs.size();
+    info->size = size;
+    for (size_t i = 0; i < inputs.size(); i++)
+        describe_tensor(inputs[i], i, &descriptors[i], &dimensions, &names);
+    for (size_t i = 0; i < outputs.size(); i++)
+        describe_tensor(outputs[i], i, &descriptors[inputs.size() + i], &dimensions, &names);
+    return info;
+}
+
+static void read_tensors(yyjson_val *tensors, std::vector<tensor_spec> &specs){
+    for (size_t i = 0; i < yyjson_arr_size(tensors); i++){
+        yyjson_val *tensor = yyjson_arr_get(tensors, i);
+        yyjson_val *name = yyjson_obj_get(tensor, "Name");
+        yyjson_val *shape = yyjson_obj_get(tensor, "Shape");
+        yyjson_val *datatype = yyjson_obj_get(tensor, "DataType");
+        tensor_spec spec;
+        spec.name = yyjson_get_str(name);
+        for (size_t j = 0; j < yyjson_arr_size(shape); j++){
+            size_t dimension = yyjson_get_int(yyjson_arr_get(shape, j));
+            // TODO: workaround for dynamic shape
+            spec.shape.push_back(dimension == 0 ? 1 : dimension);
+        }
+        spec.data_type = (tensor_data_type) yyjson_get_int(datatype);
+        specs.push_back(spec);
+    }
+}
 
 io_info* initialize_io_info(const char *json){
-    io_info *info = (io_info *) malloc(sizeof(io_info));
     yyjson_doc *doc = yyjson_read(json, strlen(json), 0);
     yyjson_val *root = yyjson_doc_get_root(doc);
     yyjson_val *inputs = yyjson_obj_get(root, "Inputs");
@@ -9,172 +107,105 @@ io_info* initialize_io_info(const char *json){
     if (!inputs || !outputs){
         printf("Error: couldn't find the Inputs and Ouputs in the JSON\n");
         yyjson_doc_free(doc);
-        free(info);
         return NULL;
     }
-    
-    // Allocate memory for the io_info structure
-    info->num_inputs = yyjson_arr_size(inputs);
-    info->num_outputs = yyjson_arr_size(outputs);
-    info->input_names = (char **)malloc(info->num_inputs * sizeof(char *));
-    info->output_names = (char **)malloc(info->num_outputs * sizeof(char *));
-    info->input_shapes = (size_t **)malloc(info->num_inputs * sizeof(size_t *));
-    info->output_shapes = (size_t **)malloc(info->num_outputs * sizeof(size_t *));
-    info->input_ranks = (size_t *)malloc(info->num_inputs * sizeof(size_t));
-    info->output_ranks = (size_t *)malloc(info->num_outputs * sizeof(size_t));
-    info->input_datatypes = (tensor_data_type *)malloc(info->num_inputs * sizeof(tensor_data_type));
-    info->output_datatypes = (tensor_data_type *)malloc(info->num_outputs * sizeof(tensor_data_type));
-
-    // Inputs
-    for (size_t i = 0; i < info->num_inputs; i++){
-        yyjson_val *input = yyjson_arr_get(inputs, i);
-        yyjson_val *name = yyjson_obj_get(input, "Name");
-        yyjson_val *shape = yyjson_obj_get(input, "Shape");
-        yyjson_val *datatype = yyjson_obj_get(input, "DataType");
-        // Name
-        const char *name_str = yyjson_get_str(name);
-        size_t name_len = strlen(name_str);
-        info->input_names[i] = (char *)malloc((name_len + 1) * sizeof(char));
-        memcpy(info->input_names[i], name_str, name_len);
-        info->input_names[i][name_len] = '\0';
-        // Rank
-        info->input_ranks[i] = yyjson_arr_size(shape);
-        // Shape
-        info->input_shapes[i] = (size_t *)malloc(info->input_ranks[i] * sizeof(size_t));
-        for (size_t j = 0; j < info->input_ranks[i]; j++){
-            yyjson_val *dim = yyjson_arr_get(shape, j);
-            info->input_shapes[i][j] = yyjson_get_int(dim);
-            // TODO: workaround for dynamic shape
-            if (info->input_shapes[i][j] == 0){
-                info->input_shapes[i][j] = 1;
-            }
-        }
-        // Data type
-        info->input_datatypes[i] = (tensor_data_type) yyjson_get_int(datatype);
+
+    std::vector<tensor_spec> input_specs;
+    std::vector<tensor_spec> output_specs;
+    read_tensors(inputs, input_specs);
+    read_tensors(outputs, output_specs);
+    yyjson_doc_free(doc);
+    return build_io_info(input_specs, output_specs);
+}
+
+io_info* initialize_io_info_from_model_info(MX::Types::MxModelInfo &model_info){
+    std::vector<tensor_spec> input_specs;
+    std::vector<tensor_spec> output_specs;
+    for (int i = 0; i < model_info.num_in_featuremaps; i++){
+        MX::Types::ShapeVector &shape = model_info.in_featuremap_shapes[i];
+        input_specs.push_back(tensor_spec{model_info.input_layer_names[i],
+                                          {(size_t)shape[0], (size_t)shape[1], (size_t)shape[2], (size_t)shape[3]},
+                                          DATA_TYPE_FLOAT});
+    }
+    for (int i = 0; i < model_info.num_out_featuremaps; i++){
+        MX::Types::ShapeVector &shape = model_info.out_featuremap_shapes[i];
+        output_specs.push_back(tensor_spec{model_info.output_layer_names[i],
+                                           {(size_t)shape[0], (size_t)shape[1], (size_t)shape[2], (size_t)shape[3]},
+                                           DATA_TYPE_FLOAT});
     }
+    return build_io_info(input_specs, output_specs);
+}
 
-    // Outputs
-    for (size_t i = 0; i < info->num_outputs; i++){
-        yyjson_val *output = yyjson_arr_get(outputs, i);
-        yyjson_val *name = yyjson_obj_get(output, "Name");
-        yyjson_val *shape = yyjson_obj_get(output, "Shape");
-        yyjson_val *datatype = yyjson_obj_get(output, "DataType");
-        // Name
-        const char *name_str = yyjson_get_str(name);
-        size_t name_len = strlen(name_str);
-        info->output_names[i] = (char *)malloc((name_len + 1) * sizeof(char));
-        memcpy(info->output_names[i], name_str, name_len);
-        info->output_names[i][name_len] = '\0';
-        // Rank
-        info->output_ranks[i] = yyjson_arr_size(shape);
-        // Shape
-        info->output_shapes[i] = (size_t *)malloc(info->output_ranks[i] * sizeof(size_t));
-        for (size_t j = 0; j < info->output_ranks[i]; j++){
-            yyjson_val *dim = yyjson_arr_get(shape, j);
-            info->output_shapes[i][j] = yyjson_get_int(dim);
-            // TODO: workaround for dynamic shape
-            if (info->output_shapes[i][j] == 0){
-                info->output_shapes[i][j] = 1;
+bool shape_needs_transpose(size_t rank, const size_t *shape, MX::Types::ShapeVector &featuremap_shape){
+    size_t permutation[MAX_PLAN_RANK];
+    return device_permutation(rank, shape, featuremap_shape, permutation) == 2 ||
+           permutation_moves_data(rank, shape, permutation);
+}
+
+/**
+ * Map the tensors to the feature maps of the same name. The mapping must be one-to-one, otherwise the tensors keep the
+ * feature map of their index.
+ */
+static void map_ports(tensor_descriptor *tensors, size_t num_tensors, const std::vector<const char*> &layer_names){
+    std::vector<bool> taken(num_tensors, false);
+    bool by_name = layer_names.size() == num_tensors;
+    for (size_t i = 0; i < num_tensors && by_name; i++){
+        by_name = false;
+        for (size_t port = 0; port < num_tensors; port++){
+            if (!taken[port] && layer_names[port] != NULL && strcmp(layer_names[port], tensors[i].name) == 0){
+                tensors[i].port = port;
+                taken[port] = true;
+                by_name = true;
+                break;
             }
         }
-        // Data type
-        info->output_datatypes[i] = (tensor_data_type) yyjson_get_int(datatype);
     }
-
-
-    yyjson_doc_free(doc);
-    return info;
+    for (size_t i = 0; i < num_tensors; i++){
+        if (!by_name)
+            tensors[i].port = i;
+        else if (tensors[i].port != (int)i)
+            printf("Warning: the tensor `%s` is fed to the feature map %d of the same name\n", tensors[i].name, tensors[i].port);
+    }
 }
 
-io_info* initialize_io_info_from_model_info(MX::Types::MxModelInfo &model_info){
-    io_info *info = (io_info *) malloc(sizeof(io_info));
-    
-    // Allocate memory for the io_info structure
-    info->num_inputs = model_info.num_in_featuremaps;
-    info->num_outputs = model_info.num_out_featuremaps;
-    info->input_names = (char **)malloc(info->num_inputs * sizeof(char *));
-    info->output_names = (char **)malloc(info->num_outputs * sizeof(char *));
-    info->input_shapes = (size_t **)malloc(info->num_inputs * sizeof(size_t *));
-    info->output_shapes = (size_t **)malloc(info->num_outputs * sizeof(size_t *));
-    info->input_ranks = (size_t *)malloc(info->num_inputs * sizeof(size_t));
-    info->output_ranks = (size_t *)malloc(info->num_outputs * sizeof(size_t));
-    info->input_datatypes = (tensor_data_type *)malloc(info->num_inputs * sizeof(tensor_data_type));
-    info->output_datatypes = (tensor_data_type *)malloc(info->num_outputs * sizeof(tensor_data_type));
-
-    // Inputs
+void bind_io_info(io_info *info, MX::Types::MxModelInfo &model_info){
+    tensor_descriptor *inputs = (tensor_descriptor *)info->inputs;
+    tensor_descriptor *outputs = (tensor_descriptor *)info->outputs;
+    map_ports(inputs, info->num_inputs, model_info.input_layer_names);
+    map_ports(outputs, info->num_outputs, model_info.output_layer_names);
     for (size_t i = 0; i < info->num_inputs; i++){
-        info->input_names[i] = (char *)malloc(strlen(model_info.input_layer_names[i]) * sizeof(char));
-        memcpy(info->input_names[i], model_info.input_layer_names[i], strlen(model_info.input_layer_names[i]));
-        info->input_ranks[i] = 4;
-        info->input_shapes[i] = (size_t *)malloc(info->input_ranks[i] * sizeof(size_t));
-        info->input_shapes[i][0] = model_info.in_featuremap_shapes[i][0];
-        info->input_shapes[i][1] = model_info.in_featuremap_shapes[i][1];
-        info->input_shapes[i][2] = model_info.in_featuremap_shapes[i][2];
-        info->input_shapes[i][3] = model_info.in_featuremap_shapes[i][3];
-        info->input_datatypes[i] = DATA_TYPE_FLOAT;
+        inputs[i].transposed = inputs[i].port < model_info.num_in_featuremaps &&
+                               shape_needs_transpose(inputs[i].rank, inputs[i].shape, model_info.in_featuremap_shapes[inputs[i].port]);
     }
-    // Outputs
     for (size_t i = 0; i < info->num_outputs; i++){
-        info->output_names[i] = (char *) malloc(strlen(model_info.output_layer_names[i]) * sizeof(char));
-        memcpy(info->output_names[i], model_info.output_layer_names[i], strlen(model_info.output_layer_names[i]));
-        info->output_ranks[i] = 4;
-        info->output_shapes[i] = (size_t *) malloc(info->output_ranks[i] * sizeof(size_t));
-        info->output_shapes[i][0] = model_info.out_featuremap_shapes[i][0];
-        info->output_shapes[i][1] = model_info.out_featuremap_shapes[i][1];
-        info->output_shapes[i][2] = model_info.out_featuremap_shapes[i][2];
-        info->output_shapes[i][3] = model_info.out_featuremap_shapes[i][3];
-        info->output_datatypes[i] = DATA_TYPE_FLOAT;
+        outputs[i].transposed = outputs[i].port < model_info.num_out_featuremaps &&
+                                shape_needs_transpose(outputs[i].rank, outputs[i].shape, model_info.out_featuremap_shapes[outputs[i].port]);
     }
-    
-    return info;
 }
 
+static void print_tensor(const tensor_descriptor *tensor){
+    printf("Name: %s, Rank: %zu, Shape: [", tensor->name, tensor->rank);
+    for (size_t j = 0; j < tensor->rank; j++){
+        printf("%zu", tensor->shape[j]);
+        if (j < tensor->rank - 1){
+            printf(", ");
+        }
+    }
+    printf("], Data type: %d, Port: %d%s\n", tensor->data_type, tensor->port, tensor->transposed ? ", transposed" : "");
+}
 
 void print_io_info(io_info *info){
     printf("IO Information:\n");
     printf("Number of inputs: %zu\n", info->num_inputs);
     printf("Number of outputs: %zu\n", info->num_outputs);
     printf("Inputs:\n");
-    for (size_t i = 0; i < info->num_inputs; i++){
-        printf("Name: %s, Rank: %zu, Shape: [", info->input_names[i], info->input_ranks[i]);
-        for (size_t j = 0; j < info->input_ranks[i]; j++){
-            printf("%zu", info->input_shapes[i][j]);
-            if (j < info->input_ranks[i] - 1){
-                printf(", ");
-            }
-        }
-        printf("], Data type: %d\n", info->input_datatypes[i]);
-    }
+    for (size_t i = 0; i < info->num_inputs; i++)
+        print_tensor(&info->inputs[i]);
     printf("Outputs:\n");
-    for (size_t i = 0; i < info->num_outputs; i++){
-        printf("Name: %s, Rank: %zu, Shape: [", info->output_names[i], info->output_ranks[i]);
-        for (size_t j = 0; j < info->output_ranks[i]; j++){
-            printf("%zu", info->output_shapes[i][j]);
-            if (j < info->output_ranks[i] - 1){
-                printf(", ");
-            }
-        }
-        printf("], Data type: %d\n", info->output_datatypes[i]);
-    }
-
+    for (size_t i = 0; i < info->num_outputs; i++)
+        print_tensor(&info->outputs[i]);
 }
 
 void free_io_info(io_info *info){
-    for (size_t i = 0; i < info->num_inputs; i++){
-        free(info->input_names[i]);
-        free(info->input_shapes[i]);
-    }
-    for (size_t i = 0; i < info->num_outputs; i++){
-        free(info->output_names[i]);
-        free(info->output_shapes[i]);
-    }
-    free(info->input_names);
-    free(info->output_names);
-    free(info->input_shapes);
-    free(info->output_shapes);
-    free(info->input_ranks);
-    free(info->output_ranks);
-    free(info->input_datatypes);
-    free(info->output_datatypes);
     free(info);
-}
\ No newline at end of file
+}
@@ -0,0 +1,308 @@
+#include "runtime_kernels.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// The blocks of the generic kernels, of constant size so that the compiler unrolls and vectorizes them
+struct generic_blocks {
+    static inline void transpose(const float *source, size_t source_stride, float *destination, size_t destination_stride){
+        for (size_t i = 0; i < TRANSPOSE_BLOCK; i++){
+            for (size_t j = 0; j < TRANSPOSE_BLOCK; j++)
+                destination[i * destination_stride + j] = source[j * source_stride + i];
+        }
+    }
+};
+
+#ifdef X86_KERNELS
+// The blocks transposed in the AVX registers: 8 loads, 24 shuffles and 8 stores
+struct avx2_blocks {
+    __attribute__((target("avx2")))
+    static inline void transpose(const float *source, size_t source_stride, float *destination, size_t destination_stride){
+        __m256 r0 = _mm256_loadu_ps(source);
+        __m256 r1 = _mm256_loadu_ps(source + source_stride);
+        __m256 r2 = _mm256_loadu_ps(source + 2 * source_stride);
+        __m256 r3 = _mm256_loadu_ps(source + 3 * source_stride);
+        __m256 r4 = _mm256_loadu_ps(source + 4 * source_stride);
+        __m256 r5 = _mm256_loadu_ps(source + 5 * source_stride);
+        __m256 r6 = _mm256_loadu_ps(source + 6 * source_stride);
+        __m256 r7 = _mm256_loadu_ps(source + 7 * source_stride);
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+        __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+        __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+        __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+        __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+        __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+        __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+        _mm256_storeu_ps(destination, _mm256_permute2f128_ps(s0, s4, 0x20));
+        _mm256_storeu_ps(destination + destination_stride, _mm256_permute2f128_ps(s1, s5, 0x20));
+        _mm256_storeu_ps(destination + 2 * destination_stride, _mm256_permute2f128_ps(s2, s6, 0x20));
+        _mm256_storeu_ps(destination + 3 * destination_stride, _mm256_permute2f128_ps(s3, s7, 0x20));
+        _mm256_storeu_ps(destination + 4 * destination_stride, _mm256_permute2f128_ps(s0, s4, 0x31));
+        _mm256_storeu_ps(destination + 5 * destination_stride, _mm256_permute2f128_ps(s1, s5, 0x31));
+        _mm256_storeu_ps(destination + 6 * destination_stride, _mm256_permute2f128_ps(s2, s6, 0x31));
+        _mm256_storeu_ps(destination + 7 * destination_stride, _mm256_permute2f128_ps(s3, s7, 0x31));
+    }
+};
+#endif
+
+static void transpose_edge(const float *source, size_t source_stride, float *destination, size_t destination_stride,
+                           size_t rows, size_t columns){
+    for (size_t i = 0; i < rows; i++){
+        for (size_t j = 0; j < columns; j++)
+            destination[i * destination_stride + j] = source[j * source_stride + i];
+    }
+}
+
+// The rows [begin, end) of a 2D transpose, the rows being contiguous in the source and the columns in the destination
+template <typename BLOCKS>
+static void transpose_2d(const float *source, size_t source_stride, float *destination, size_t destination_stride,
+                         size_t begin, size_t end, size_t columns){
+    size_t i = begin;
+    for (; i + TRANSPOSE_BLOCK <= end; i += TRANSPOSE_BLOCK){
+        size_t j = 0;
+        for (; j + TRANSPOSE_BLOCK <= columns; j += TRANSPOSE_BLOCK)
+            BLOCKS::transpose(source + i + j * source_stride, source_stride, destination + i * destination_stride + j, destination_stride);
+        transpose_edge(source + i + j * source_stride, source_stride, destination + i * destination_stride + j, destination_stride,
+                       TRANSPOSE_BLOCK, columns - j);
+    }
+    transpose_edge(source + i, source_stride, destination + i * destination_stride, destination_stride, end - i, columns);
+}
+
+/**
+ * The indices [begin, end) of the split axes of the converted tensor, the inner axis counting blocks of rows. The axes
+ * which are not split are looped over in full for each index.
+ */
+template <typename BLOCKS>
+static void permute_range(void *arg, size_t begin, size_t end){
+    const conversion_job *job = (const conversion_job *)arg;
+    const conversion_plan *plan = job->plan;
+    size_t last = plan->num_axes - 1;
+    size_t inner = plan->inner_axis;
+    size_t split = plan->num_split_axes;
+    size_t index[MAX_PLAN_RANK] = {0};
+    for (size_t d = split, rest = begin; d-- > 0;){
+        index[d] = rest % plan->split_extents[d];
+        rest /= plan->split_extents[d];
+    }
+    for (size_t task = begin; task < end;){
+        // Consecutive blocks of the inner axis, when it is the last axis split, are transposed at once
+        size_t run = 1;
+        size_t inner_begin = 0, inner_end = plan->extents[inner];
+        if (inner < split){
+            if (inner == split - 1)
+                run = std::min(end - task, plan->split_extents[inner] - index[inner]);
+            inner_begin = index[inner] * TRANSPOSE_BLOCK;
+            inner_end = std::min((index[inner] + run) * TRANSPOSE_BLOCK, plan->extents[inner]);
+        }
+        while (true){
+            size_t source_offset = 0, destination_offset = 0;
+            for (size_t d = 0; d < last; d++){
+                if (d == inner)
+                    continue;
+                source_offset += index[d] * plan->source_strides[d];
+                destination_offset += index[d] * plan->destination_strides[d];
+            }
+            // Runs contiguous in both tensors are copied, the others transposed with the inner axis
+            if (inner == last)
+                memcpy(job->destination + destination_offset, job->source + source_offset, plan->extents[last] * sizeof(float));
+            else
+                transpose_2d<BLOCKS>(job->source + source_offset, plan->source_strides[last], job->destination + destination_offset,
+                                     plan->destination_strides[inner], inner_begin, inner_end, plan->extents[last]);
+
+            // Next index of the axes which are not split, from the innermost one
+            size_t d = last;
+            while (d-- > split){
+                if (d == inner)
+                    continue;
+                if (++index[d] < plan->extents[d])
+                    break;
+                index[d] = 0;
+            }
+            if (d < split)
+                break;
+        }
+
+        // Next index of the split axes
+        task += run;
+        index[split - 1] += run;
+        for (size_t d = split - 1; d > 0 && index[d] == plan->split_extents[d]; d--){
+            index[d] = 0;
+            index[d - 1]++;
+        }
+    }
+}
+
+/**
+ * The conversion of images to channel last, at the pixels [begin, end) of the image at `source`: the CHANNELS channel
+ * planes are transposed, with the channels of each pixel contiguous in the destination. Meant for fewer channels than
+ * a block, where the generic transpose only runs partial blocks.
+ */
+template <size_t CHANNELS>
+static inline void interleave_image(const float *source, float *destination, size_t plane, size_t begin, size_t end){
+    size_t i = begin;
+    for (; i + TRANSPOSE_BLOCK <= end; i += TRANSPOSE_BLOCK){
+        for (size_t c = 0; c < CHANNELS; c++){
+            for (size_t k = 0; k < TRANSPOSE_BLOCK; k++)
+                destination[(i + k) * CHANNELS + c] = source[c * plane + i + k];
+        }
+    }
+    for (; i < end; i++){
+        for (size_t c = 0; c < CHANNELS; c++)
+            destination[i * CHANNELS + c] = source[c * plane + i];
+    }
+}
+
+// The conversion of images of CHANNELS channels from channel last, at the pixels [begin, end) of the image at `source`
+template <size_t CHANNELS, typename BLOCKS>
+static inline void deinterleave_image(const float *source, float *destination, size_t plane, size_t begin, size_t end){
+    const size_t full_channels = CHANNELS / TRANSPOSE_BLOCK * TRANSPOSE_BLOCK;
+    size_t j = begin;
+    for (; j + TRANSPOSE_BLOCK <= end; j += TRANSPOSE_BLOCK){
+        for (size_t c = 0; c < full_channels; c += TRANSPOSE_BLOCK)
+            BLOCKS::transpose(source + j * CHANNELS + c, CHANNELS, destination + c * plane + j, plane);
+        for (size_t c = full_channels; c < CHANNELS; c++){
+            for (size_t k = 0; k < TRANSPOSE_BLOCK; k++)
+                destination[c * plane + j + k] = source[(j + k) * CHANNELS + c];
+        }
+    }
+    for (; j < end; j++){
+        for (size_t c = 0; c < CHANNELS; c++)
+            destination[c * plane + j] = source[j * CHANNELS + c];
+    }
+}
+
+/**
+ * The pixels [begin, end) of a batch of images, numbered from the first image: the plan has the channels and the
+ * pixels as its last two axes, after the batch if there is one.
+ */
+template <bool INTERLEAVE, size_t CHANNELS, typename BLOCKS>
+static void convert_images(void *arg, size_t begin, size_t end){
+    const conversion_job *job = (const conversion_job *)arg;
+    const conversion_plan *plan = job->plan;
+    size_t plane = INTERLEAVE ? plan->extents[plan->num_axes - 2] : plan->extents[plan->num_axes - 1];
+    while (begin < end){
+        size_t image = begin / plane;
+        size_t stop = std::min(end, (image + 1) * plane);
+        const float *source = job->source + image * plane * CHANNELS;
+        float *destination = job->destination + image * plane * CHANNELS;
+        if (INTERLEAVE)
+            interleave_image<CHANNELS>(source, destination, plane, begin - image * plane, stop - image * plane);
+        else
+            deinterleave_image<CHANNELS, BLOCKS>(source, destination, plane, begin - image * plane, stop - image * plane);
+        begin = stop;
+    }
+}
+
+template <size_t CHANNELS>
+static void interleave_range(void *arg, size_t begin, size_t end){
+    convert_images<true, CHANNELS, generic_blocks>(arg, begin, end);
+}
+
+template <size_t CHANNELS, typename BLOCKS>
+static void deinterleave_range(void *arg, size_t begin, size_t end){
+    convert_images<false, CHANNELS, BLOCKS>(arg, begin, end);
+}
+
+/**
+ * The numbers of channels of RGB and RGBA images, of the usual backbones, and of the COCO detection heads, measured
+ * with `conversion_benchmark`. Towards channel last, the blocks of the generic transpose are as fast from 16 channels
+ * on; from channel last, they are from 32 channels on only, and for 16 neither direction gains. One channel is a
+ * reshape, which needs no kernel.
+ */
+static const specialized_kernel generic_specialized[] = {
+    {3, interleave_range<3>, deinterleave_range<3, generic_blocks>, "3 channels"},
+    {4, interleave_range<4>, deinterleave_range<4, generic_blocks>, "4 channels"},
+    {32, NULL, deinterleave_range<32, generic_blocks>, "32 channels"},
+    {64, NULL, deinterleave_range<64, generic_blocks>, "64 channels"},
+    {80, NULL, deinterleave_range<80, generic_blocks>, "80 channels"},
+    {85, NULL, deinterleave_range<85, generic_blocks>, "85 channels"},
+    {255, NULL, deinterleave_range<255, generic_blocks>, "255 channels"},
+};
+
+#ifdef X86_KERNELS
+// The same kernels compiled again for AVX2, with all the functions they call inlined into them
+template <range_function KERNEL>
+__attribute__((target("avx2"), flatten))
+static void avx2_kernel(void *arg, size_t begin, size_t end){
+    KERNEL(arg, begin, end);
+}
+
+/**
+ * With the blocks transposed in registers, the generic kernel converts from channel last faster than the specialized
+ * one from 80 channels on, as it writes fewer channel planes at a time.
+ */
+static const specialized_kernel avx2_specialized[] = {
+    {3, avx2_kernel<interleave_range<3>>, avx2_kernel<deinterleave_range<3, avx2_blocks>>, "3 channels"},
+    {4, avx2_kernel<interleave_range<4>>, avx2_kernel<deinterleave_range<4, avx2_blocks>>, "4 channels"},
+    {32, NULL, avx2_kernel<deinterleave_range<32, avx2_blocks>>, "32 channels"},
+    {64, NULL, avx2_kernel<deinterleave_range<64, avx2_blocks>>, "64 channels"},
+};
+#endif
+
+#define NUM_KERNELS(kernels) (sizeof(kernels) / sizeof(kernels[0]))
+
+static const conversion_kernels kernel_sets[] = {
+    {CONVERSION_ISA_GENERIC, "generic", permute_range<generic_blocks>, generic_specialized, NUM_KERNELS(generic_specialized)},
+#ifdef X86_KERNELS
+    {CONVERSION_ISA_AVX2, "avx2", avx2_kernel<permute_range<avx2_blocks>>, avx2_specialized, NUM_KERNELS(avx2_specialized)},
+#endif
+};
+
+static std::atomic<const conversion_kernels *> active_kernels(NULL);
+
+conversion_isa detect_conversion_isa(){
+#ifdef X86_KERNELS
+    // Also checks that the OS saves the AVX registers
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return CONVERSION_ISA_AVX2;
+#endif
+    return CONVERSION_ISA_GENERIC;
+}
+
+int set_conversion_isa(int isa){
+    conversion_isa supported = detect_conversion_isa();
+    if (isa == CONVERSION_ISA_AUTO)
+        isa = supported;
+    if (isa < CONVERSION_ISA_GENERIC || isa > CONVERSION_ISA_AVX2){
+        printf("Error: unknown conversion instruction set %d\n", isa);
+        return 1;
+    }
+    if (isa > supported){
+        printf("Error: the CPU does not support the conversion instruction set %d, it supports up to %d\n", isa, supported);
+        return 1;
+    }
+    for (const conversion_kernels &kernels : kernel_sets){
+        if (kernels.isa == isa){
+            active_kernels = &kernels;
+            return 0;
+        }
+    }
+    printf("Error: the conversion kernels %d are not built for this target\n", isa);
+    return 1;
+}
+
+const conversion_kernels *active_conversion_kernels(){
+    const conversion_kernels *kernels = active_kernels.load();
+    if (kernels == NULL){
+        set_conversion_isa(CONVERSION_ISA_AUTO);
+        kernels = active_kernels.load();
+    }
+    return kernels;
+}
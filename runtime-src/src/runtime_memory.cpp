@@ -0,0 +1,142 @@
+#include "runtime_memory.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Mapped buffers kept after being freed, so that the next frame reuses their pages instead of faulting new ones in
+#define MAX_CACHED_BUFFERS 16
+
+typedef enum buffer_kind {
+    BUFFER_HEAP = 0,
+    BUFFER_MAPPED = 1,
+    BUFFER_HUGETLB = 2
+} buffer_kind;
+
+// Stored right before the data, which keeps the data aligned
+typedef struct alignas(TENSOR_ALIGNMENT) buffer_header {
+    void *base;
+    size_t mapped_size;
+    size_t size;
+    buffer_kind kind;
+} buffer_header;
+
+static std::atomic<int> huge_pages(HUGE_PAGES_TRANSPARENT);
+static std::atomic<bool> hugetlb_warned(false);
+static std::atomic<size_t> live_bytes(0);
+static std::atomic<size_t> huge_page_bytes(0);
+static std::mutex cache_mutex;
+static std::vector<buffer_header> cached_buffers;
+
+static size_t round_up(size_t size, size_t alignment){
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+void memory_set_huge_pages(int mode){
+    huge_pages = mode;
+}
+
+/**
+ * Map the buffer on huge-page boundaries, so that the kernel can back all of it with huge pages: map one huge page more
+ * than needed and give back the ends.
+ */
+static void *map_aligned(size_t mapped_size){
+    size_t length = mapped_size + HUGE_PAGE_SIZE;
+    char *mapping = (char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED)
+        return NULL;
+    char *base = (char *)round_up((uintptr_t)mapping, HUGE_PAGE_SIZE);
+    if (base > mapping)
+        munmap(mapping, base - mapping);
+    munmap(base + mapped_size, mapping + length - (base + mapped_size));
+    return base;
+}
+
+static bool take_cached(int mode, buffer_header *header){
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    for (size_t i = 0; i < cached_buffers.size(); i++){
+        const buffer_header &cached = cached_buffers[i];
+        if (cached.mapped_size == header->mapped_size && (mode == HUGE_PAGES_EXPLICIT || cached.kind == BUFFER_MAPPED)){
+            header->base = cached.base;
+            header->kind = cached.kind;
+            cached_buffers[i] = cached_buffers.back();
+            cached_buffers.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void *tensor_alloc(size_t size){
+    int mode = huge_pages.load(std::memory_order_relaxed);
+    size_t total = sizeof(buffer_header) + size;
+    buffer_header header = {NULL, 0, size, BUFFER_HEAP};
+    if (mode != HUGE_PAGES_NONE && total >= HUGE_PAGE_SIZE / 2){
+        header.mapped_size = round_up(total, HUGE_PAGE_SIZE);
+        if (!take_cached(mode, &header) && mode == HUGE_PAGES_EXPLICIT){
+            void *base = mmap(NULL, header.mapped_size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (base != MAP_FAILED){
+                header.base = base;
+                header.kind = BUFFER_HUGETLB;
+            } else if (!hugetlb_warned.exchange(true)){
+                printf("Warning: no huge page left in the pool, using transparent huge pages\n");
+            }
+        }
+        if (header.base == NULL){
+            header.base = map_aligned(header.mapped_size);
+            if (header.base != NULL){
+                header.kind = BUFFER_MAPPED;
+                madvise(header.base, header.mapped_size, MADV_HUGEPAGE);
+            }
+        }
+    }
+    if (header.base == NULL){
+        header.kind = BUFFER_HEAP;
+        header.mapped_size = 0;
+        if (posix_memalign(&header.base, TENSOR_ALIGNMENT, total) != 0)
+            return NULL;
+    }
+    live_bytes += size;
+    if (header.kind != BUFFER_HEAP)
+        huge_page_bytes += size;
+    buffer_header *stored = (buffer_header *)header.base;
+    *stored = header;
+    return stored + 1;
+}
+
+void tensor_free(void *data){
+    if (data == NULL)
+        return;
+    buffer_header header = ((buffer_header *)data)[-1];
+    live_bytes -= header.size;
+    if (header.kind == BUFFER_HEAP){
+        free(header.base);
+        return;
+    }
+    huge_page_bytes -= header.size;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        if (cached_buffers.size() < MAX_CACHED_BUFFERS){
+            cached_buffers.push_back(header);
+            return;
+        }
+    }
+    munmap(header.base, header.mapped_size);
+}
+
+void memory_trim(){
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    for (const buffer_header &cached : cached_buffers)
+        munmap(cached.base, cached.mapped_size);
+    cached_buffers.clear();
+}
+
+void memory_usage(size_t *total_bytes, size_t *huge_bytes){
+    *total_bytes = live_bytes.load();
+    *huge_bytes = huge_page_bytes.load();
+}
@@ -0,0 +1,125 @@
+#include "runtime_memory_benchmark.hpp"
+#include "runtime_memory.hpp"
+#include "runtime_utils.hpp"
+#include "runtime_stats.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct benchmark_tensor {
+    const char *label;
+    // NCHW for the inputs, and the NCHW shape of the NHWC device layout for the outputs
+    size_t shape[4];
+    bool output;
+} benchmark_tensor;
+
+typedef struct benchmark_allocator {
+    const char *label;
+    // -1 for malloc
+    int huge_pages;
+} benchmark_allocator;
+
+static void *allocate(const benchmark_allocator *allocator, size_t size){
+    if (allocator->huge_pages < 0)
+        return malloc(size);
+    memory_set_huge_pages(allocator->huge_pages);
+    return tensor_alloc(size);
+}
+
+static void release(const benchmark_allocator *allocator, void *data){
+    if (allocator->huge_pages < 0)
+        free(data);
+    else
+        tensor_free(data);
+}
+
+static int transpose(const benchmark_tensor *tensor, tensors_struct *tensors, float *destination){
+    if (tensor->output)
+        return transpose_output_data_into(0, tensors, destination);
+    return transpose_input_data_into(0, tensors, destination);
+}
+
+/**
+ * Transpose a tensor `iterations` times and return the MB/s of converted data, with a new destination per frame when
+ * `per_frame` is set.
+ */
+static double measure_transpose(const benchmark_tensor *tensor, const benchmark_allocator *allocator, int iterations,
+                                bool per_frame){
+    size_t size = sizeof(float);
+    for (size_t dimension : tensor->shape)
+        size *= dimension;
+    float *source = (float *)allocate(allocator, size);
+    float *destination = per_frame ? NULL : (float *)allocate(allocator, size);
+    if (source == NULL || (!per_frame && destination == NULL)){
+        release(allocator, source);
+        release(allocator, destination);
+        return 0;
+    }
+    for (size_t i = 0; i < size / sizeof(float); i++)
+        source[i] = (float)i;
+    if (destination != NULL)
+        memset(destination, 0, size);
+
+    char name[] = "benchmark";
+    char *names[] = {name};
+    tensor_data_type data_type = DATA_TYPE_FLOAT;
+    size_t rank = 4;
+    size_t *shapes[] = {(size_t *)tensor->shape};
+    void *data[] = {source};
+    tensors_struct tensors = {1, names, &data_type, &rank, shapes, data};
+
+    double start_us = stats_now_us();
+    for (int i = 0; i < iterations; i++){
+        float *target = per_frame ? (float *)allocate(allocator, size) : destination;
+        if (target == NULL || transpose(tensor, &tensors, target) != 0){
+            if (per_frame)
+                release(allocator, target);
+            release(allocator, source);
+            release(allocator, destination);
+            return 0;
+        }
+        if (per_frame)
+            release(allocator, target);
+    }
+    double elapsed_us = stats_now_us() - start_us;
+    release(allocator, source);
+    release(allocator, destination);
+    memory_trim();
+    return (double)size * iterations / elapsed_us;
+}
+
+void run_memory_benchmark(int iterations){
+    const benchmark_tensor tensors[] = {
+        {"input 3x640x640", {1, 3, 640, 640}, false},
+        {"output 255x80x80", {1, 255, 80, 80}, true},
+        {"output 255x40x40", {1, 255, 40, 40}, true},
+        {"output 85x8400", {1, 85, 1, 8400}, true},
+    };
+    const benchmark_allocator allocators[] = {
+        {"malloc", -1},
+        {"aligned", HUGE_PAGES_NONE},
+        {"transparent", HUGE_PAGES_TRANSPARENT},
+        {"explicit", HUGE_PAGES_EXPLICIT},
+    };
+    printf("Memory benchmark: %d frames, MB/s of transposed data, new buffer per frame / reused buffer\n", iterations);
+    printf("%-18s", "tensor");
+    for (const benchmark_allocator &allocator : allocators)
+        printf(" %23s", allocator.label);
+    printf("\n");
+    const size_t num_allocators = sizeof(allocators) / sizeof(allocators[0]);
+    for (const benchmark_tensor &tensor : tensors){
+        // Measure the whole row first, the allocators may print warnings
+        double per_frame[num_allocators];
+        double reused[num_allocators];
+        for (size_t a = 0; a < num_allocators; a++){
+            per_frame[a] = measure_transpose(&tensor, &allocators[a], iterations, true);
+            reused[a] = measure_transpose(&tensor, &allocators[a], iterations, false);
+        }
+        printf("%-18s", tensor.label);
+        for (size_t a = 0; a < num_allocators; a++)
+            printf(" %11.0f / %9.0f", per_frame[a], reused[a]);
+        printf("\n");
+    }
+    memory_set_huge_pages(HUGE_PAGES_TRANSPARENT);
+}
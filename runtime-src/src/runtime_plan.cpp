@@ -0,0 +1,375 @@
+#include "runtime_plan.hpp"
+#include "runtime_kernels.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+// Rows of about 64 KB are worth handing to a conversion worker
+#define CONVERSION_GRAIN_ELEMENTS 16384
+// Indices the generic kernel needs for the tasks to go around the workers, its first axes are split until it has them
+#define CONVERSION_MIN_INDICES 256
+
+typedef struct port_plans {
+    std::atomic<conversion_plan *> plans[MAX_CACHED_PLANS];
+    std::atomic<int> num_plans;
+    // plan of the shape last seen
+    std::atomic<int> last;
+} port_plans;
+
+static port_plans *input_plans = NULL;
+static conversion_plan *output_plans = NULL;
+static size_t num_inputs = 0;
+static size_t num_outputs = 0;
+// by input, the feature map the new shapes are compared to, if the input has one
+static std::vector<MX::Types::ShapeVector> input_featuremaps;
+static std::vector<bool> input_bound;
+static std::mutex plans_mutex;
+
+void use_generic_kernel(conversion_plan *plan){
+    if (plan->kind != CONVERSION_PERMUTE)
+        return;
+    plan->kernel = active_conversion_kernels()->permute;
+    plan->kernel_name = "generic";
+    // A batch, or a tensor whose first axis is short, is also shared by the next axes, down to blocks of rows
+    plan->num_split_axes = 0;
+    plan->num_indices = 1;
+    while (plan->num_split_axes < plan->num_axes - 1 && plan->num_indices < CONVERSION_MIN_INDICES){
+        size_t d = plan->num_split_axes++;
+        plan->split_extents[d] = d == plan->inner_axis ? (plan->extents[d] + TRANSPOSE_BLOCK - 1) / TRANSPOSE_BLOCK
+                                                       : plan->extents[d];
+        plan->num_indices *= plan->split_extents[d];
+    }
+    size_t per_index = plan->size / sizeof(float) / plan->num_indices;
+    plan->grain = (CONVERSION_GRAIN_ELEMENTS + per_index - 1) / per_index;
+}
+
+/**
+ * Pick the kernel of a plan, the permutations which are a 2D transpose of a specialized number of channels, for each
+ * image of a batch if there is one.
+ */
+static void select_kernel(conversion_plan *plan){
+    use_generic_kernel(plan);
+    if (plan->num_axes < 2 || plan->num_axes > 3 || plan->inner_axis != plan->num_axes - 2)
+        return;
+    size_t batch = plan->num_axes == 3 ? plan->extents[0] : 1;
+    const size_t *extents = plan->extents + plan->num_axes - 2;
+    const conversion_kernels *kernels = active_conversion_kernels();
+    for (size_t i = 0; i < kernels->num_specialized; i++){
+        const specialized_kernel &kernel = kernels->specialized[i];
+        // To channel last the channels are the last axis, and from channel last the one before
+        bool to_channel_last = kernel.interleave != NULL && kernel.channels == extents[1];
+        if (!to_channel_last && (kernel.deinterleave == NULL || kernel.channels != extents[0]))
+            continue;
+        // The pixels of all the images are shared between the workers
+        plan->kernel = to_channel_last ? kernel.interleave : kernel.deinterleave;
+        plan->kernel_name = kernel.name;
+        plan->num_indices = batch * (to_channel_last ? extents[0] : extents[1]);
+        plan->grain = (CONVERSION_GRAIN_ELEMENTS + kernel.channels - 1) / kernel.channels;
+        return;
+    }
+}
+
+/**
+ * Drop the axes of one, and merge the axes which follow each other in both tensors. The axes are written in the order
+ * of the converted tensor, with their strides in the tensor.
+ */
+static size_t collapse_axes(size_t rank, const size_t *shape, const size_t *permutation, size_t *extents, size_t *strides){
+    size_t source_strides[MAX_PLAN_RANK];
+    size_t stride = 1;
+    for (size_t axis = rank; axis-- > 0;){
+        source_strides[axis] = stride;
+        stride *= shape[axis];
+    }
+    size_t num_axes = 0;
+    for (size_t d = 0; d < rank; d++){
+        size_t axis = permutation[d];
+        if (shape[axis] == 1)
+            continue;
+        if (num_axes > 0 && strides[num_axes - 1] == source_strides[axis] * shape[axis]){
+            extents[num_axes - 1] *= shape[axis];
+            strides[num_axes - 1] = source_strides[axis];
+            continue;
+        }
+        extents[num_axes] = shape[axis];
+        strides[num_axes] = source_strides[axis];
+        num_axes++;
+    }
+    return num_axes;
+}
+
+void channel_last_permutation(size_t rank, size_t *permutation){
+    for (size_t d = 0; d < rank; d++)
+        permutation[d] = d;
+    if (rank < 3)
+        return;
+    // N, C, D, H, W to N, H, W, D, C for the Z dimension, and N, C, ... to N, ..., C otherwise
+    if (rank == 5){
+        permutation[1] = 3;
+        permutation[2] = 4;
+        permutation[3] = 2;
+    } else {
+        for (size_t d = 1; d < rank - 1; d++)
+            permutation[d] = d + 1;
+    }
+    permutation[rank - 1] = 1;
+}
+
+// Check if a shape, permuted, is the one of a feature map once their ones are dropped
+static bool same_dimensions(size_t rank, const size_t *shape, const size_t *permutation, MX::Types::ShapeVector &featuremap_shape){
+    size_t d = 0;
+    for (int j = 0; j < 4; j++){
+        if (featuremap_shape[j] == 1)
+            continue;
+        while (d < rank && shape[permutation[d]] == 1)
+            d++;
+        if (d == rank || (int64_t)shape[permutation[d]] != featuremap_shape[j])
+            return false;
+        d++;
+    }
+    while (d < rank && shape[permutation[d]] == 1)
+        d++;
+    return d == rank;
+}
+
+int device_permutation(size_t rank, const size_t *shape, MX::Types::ShapeVector &featuremap_shape, size_t *permutation){
+    if (rank > MAX_PLAN_RANK)
+        return 2;
+    size_t identity[MAX_PLAN_RANK];
+    for (size_t d = 0; d < rank; d++)
+        identity[d] = d;
+    channel_last_permutation(rank, permutation);
+
+    int64_t num_elements = 1, featuremap_elements = 1;
+    for (size_t d = 0; d < rank; d++)
+        num_elements *= shape[d];
+    for (int j = 0; j < 4; j++)
+        featuremap_elements *= featuremap_shape[j];
+    if (num_elements != featuremap_elements)
+        return 2;
+
+    bool as_is = same_dimensions(rank, shape, identity, featuremap_shape);
+    bool channel_last = same_dimensions(rank, shape, permutation, featuremap_shape);
+    bool moves_data = permutation_moves_data(rank, shape, permutation);
+    if (as_is && channel_last && moves_data){
+        // Both fit, e.g. [1, 4, 4, 4] and (4, 4, 1, 4): the tensor is in the layout of the accelerator when its
+        // dimensions are the ones of the feature map in the same places
+        for (size_t d = 0; d < rank && d < 4; d++){
+            if (shape[d] != 1 && (int64_t)shape[d] != featuremap_shape[d]){
+                as_is = false;
+                break;
+            }
+        }
+    }
+    if (as_is && moves_data)
+        memcpy(permutation, identity, rank * sizeof(size_t));
+    return as_is || channel_last ? 0 : 1;
+}
+
+bool permutation_moves_data(size_t rank, const size_t *shape, const size_t *permutation){
+    size_t extents[MAX_PLAN_RANK];
+    size_t strides[MAX_PLAN_RANK];
+    size_t num_axes = collapse_axes(rank, shape, permutation, extents, strides);
+    return num_axes > 1 || (num_axes == 1 && strides[0] != 1);
+}
+
+uint64_t shape_signature(size_t rank, const size_t *shape){
+    // FNV-1a over the rank and the dimensions
+    uint64_t signature = 14695981039346656037ULL;
+    signature = (signature ^ rank) * 1099511628211ULL;
+    for (size_t i = 0; i < rank; i++)
+        signature = (signature ^ shape[i]) * 1099511628211ULL;
+    return signature;
+}
+
+int compile_conversion_plan(size_t rank, const size_t *shape, const size_t *permutation, conversion_plan *plan){
+    memset(plan, 0, sizeof(conversion_plan));
+    plan->rank = rank < MAX_PLAN_RANK ? rank : MAX_PLAN_RANK;
+    memcpy(plan->shape, shape, plan->rank * sizeof(size_t));
+    plan->signature = shape_signature(rank, shape);
+    plan->size = sizeof(float);
+    for (size_t i = 0; i < rank; i++)
+        plan->size *= shape[i];
+    plan->kind = CONVERSION_INVALID;
+    if (rank > MAX_PLAN_RANK){
+        printf("Error: tensors of rank %zu are not supported, the highest rank is %d\n", rank, MAX_PLAN_RANK);
+        return 1;
+    }
+    unsigned seen = 0;
+    for (size_t d = 0; d < rank; d++){
+        if (permutation[d] >= rank || (seen & (1u << permutation[d]))){
+            printf("Error: invalid permutation of the axes of a tensor of rank %zu\n", rank);
+            return 1;
+        }
+        seen |= 1u << permutation[d];
+    }
+
+    plan->num_axes = collapse_axes(rank, shape, permutation, plan->extents, plan->source_strides);
+    if (plan->num_axes == 0 || (plan->num_axes == 1 && plan->source_strides[0] == 1)){
+        plan->kind = CONVERSION_NONE;
+        plan->num_axes = 0;
+        return 0;
+    }
+    plan->kind = CONVERSION_PERMUTE;
+    size_t stride = 1;
+    for (size_t d = plan->num_axes; d-- > 0;){
+        plan->destination_strides[d] = stride;
+        stride *= plan->extents[d];
+        // The innermost axis of the tensor, which has stride 1, is never merged away
+        if (plan->source_strides[d] == 1)
+            plan->inner_axis = d;
+    }
+    select_kernel(plan);
+    return 0;
+}
+
+int run_conversion_plan(const conversion_plan *plan, const float *source, float *destination){
+    if (plan->kind == CONVERSION_NONE)
+        return 0;
+    if (plan->kind != CONVERSION_PERMUTE)
+        return 1;
+    conversion_job job = {plan, source, destination};
+    executor_parallel_for(plan->num_indices, plan->grain, plan->kernel, &job);
+    return 0;
+}
+
+/**
+ * Plan the conversion of a tensor to its feature map, or from it for an output, whose source is the device layout of
+ * the tensor. The tensors without a feature map are used as is.
+ */
+static void compile_port_plan(bool output, size_t index, size_t rank, const size_t *shape,
+                              MX::Types::ShapeVector *featuremap_shape, conversion_plan *plan){
+    const char *direction = output ? "output" : "input";
+    if (rank > MAX_PLAN_RANK){
+        // Invalid, with its error
+        compile_conversion_plan(rank, shape, NULL, plan);
+        return;
+    }
+    size_t permutation[MAX_PLAN_RANK] = {0};
+    int match = featuremap_shape == NULL ? 0 : device_permutation(rank, shape, *featuremap_shape, permutation);
+    if (featuremap_shape == NULL || match == 2){
+        for (size_t d = 0; d < rank; d++)
+            permutation[d] = d;
+    }
+    if (match == 1)
+        printf("Warning: the %s %zu matches its feature map neither as is nor channel last, it is taken as channel first\n",
+               direction, index);
+    if (!output){
+        compile_conversion_plan(rank, shape, permutation, plan);
+    } else {
+        // From the device layout of the output, the shape permuted, back to its own layout
+        size_t device_shape[MAX_PLAN_RANK] = {0};
+        size_t inverse[MAX_PLAN_RANK] = {0};
+        for (size_t d = 0; d < rank; d++){
+            device_shape[d] = shape[permutation[d]];
+            inverse[permutation[d]] = d;
+        }
+        compile_conversion_plan(rank, device_shape, inverse, plan);
+    }
+    if (match == 2){
+        printf("Error: the %s %zu and its feature map have different numbers of elements\n", direction, index);
+        plan->kind = CONVERSION_INVALID;
+    }
+}
+
+static void compile_input_plan(size_t index, size_t rank, const size_t *shape, conversion_plan *plan){
+    compile_port_plan(false, index, rank, shape, input_bound[index] ? &input_featuremaps[index] : NULL, plan);
+}
+
+int plans_build(const io_info *info, MX::Types::MxModelInfo &model_info){
+    if (input_plans != NULL){
+        printf("Error: the conversion plans are already built\n");
+        return 1;
+    }
+    num_inputs = info->num_inputs;
+    num_outputs = info->num_outputs;
+    input_featuremaps.assign(num_inputs, MX::Types::ShapeVector());
+    input_bound.assign(num_inputs, false);
+    for (size_t i = 0; i < num_inputs; i++){
+        int port = info->inputs[i].port;
+        if (port < model_info.num_in_featuremaps){
+            input_featuremaps[i] = model_info.in_featuremap_shapes[port];
+            input_bound[i] = true;
+        }
+    }
+
+    input_plans = new port_plans[num_inputs];
+    for (size_t i = 0; i < num_inputs; i++){
+        port_plans &ports = input_plans[i];
+        for (int k = 0; k < MAX_CACHED_PLANS; k++)
+            ports.plans[k] = NULL;
+        conversion_plan *plan = new conversion_plan;
+        compile_input_plan(i, info->inputs[i].rank, info->inputs[i].shape, plan);
+        ports.plans[0] = plan;
+        ports.num_plans = 1;
+        ports.last = 0;
+    }
+    output_plans = new conversion_plan[num_outputs];
+    for (size_t i = 0; i < num_outputs; i++){
+        const tensor_descriptor &output = info->outputs[i];
+        bool bound = output.port < model_info.num_out_featuremaps;
+        compile_port_plan(true, i, output.rank, output.shape, bound ? &model_info.out_featuremap_shapes[output.port] : NULL,
+                          &output_plans[i]);
+    }
+    return 0;
+}
+
+void plans_free(){
+    for (size_t i = 0; i < num_inputs; i++){
+        for (int k = 0; k < MAX_CACHED_PLANS; k++)
+            delete input_plans[i].plans[k].load();
+    }
+    delete[] input_plans;
+    input_plans = NULL;
+    delete[] output_plans;
+    output_plans = NULL;
+    num_inputs = 0;
+    num_outputs = 0;
+}
+
+static bool plan_matches(const conversion_plan *plan, uint64_t signature, size_t rank, const size_t *shape){
+    return plan->signature == signature && plan->rank == rank && memcmp(plan->shape, shape, rank * sizeof(size_t)) == 0;
+}
+
+const conversion_plan *find_input_plan(size_t index, size_t rank, const size_t *shape, conversion_plan *fallback){
+    port_plans &ports = input_plans[index];
+    uint64_t signature = shape_signature(rank, shape);
+    // Acquire pairs with the release stores of `last`, which follow the store of their plan
+    int last = ports.last.load(std::memory_order_acquire);
+    conversion_plan *plan = ports.plans[last].load(std::memory_order_acquire);
+    if (plan != NULL && plan_matches(plan, signature, rank, shape))
+        return plan;
+    int num_plans = ports.num_plans.load(std::memory_order_acquire);
+    for (int k = 0; k < num_plans; k++){
+        plan = ports.plans[k].load(std::memory_order_acquire);
+        if (plan_matches(plan, signature, rank, shape)){
+            ports.last.store(k, std::memory_order_release);
+            return plan;
+        }
+    }
+
+    // A new shape: keep its plan, unless another thread just did
+    std::lock_guard<std::mutex> lock(plans_mutex);
+    num_plans = ports.num_plans.load(std::memory_order_relaxed);
+    for (int k = 0; k < num_plans; k++){
+        plan = ports.plans[k].load(std::memory_order_relaxed);
+        if (plan_matches(plan, signature, rank, shape))
+            return plan;
+    }
+    if (num_plans == MAX_CACHED_PLANS || rank > MAX_PLAN_RANK){
+        compile_input_plan(index, rank, shape, fallback);
+        return fallback;
+    }
+    plan = new conversion_plan;
+    compile_input_plan(index, rank, shape, plan);
+    ports.plans[num_plans].store(plan, std::memory_order_release);
+    ports.num_plans.store(num_plans + 1, std::memory_order_release);
+    ports.last.store(num_plans, std::memory_order_release);
+    return plan;
+}
+
+const conversion_plan *output_plan(size_t index){
+    return &output_plans[index];
+}
@@ -0,0 +1,96 @@
+#include "runtime_queue_benchmark.hpp"
+#include "runtime_ring.hpp"
+#include "runtime_stats.hpp"
+#include "memx/utils/sync_queue.hpp"
+#include "memx/utils/general.h"
+
+#include <stdio.h>
+#include <vector>
+#include <thread>
+
+#define BENCHMARK_QUEUE_CAPACITY 1024
+
+/**
+ * Run `producers` threads pushing `items` items in total and `consumers` threads popping them, and return the number
+ * of items per second. `pop` blocks until an item comes, and each consumer stops at the 0 item pushed once the
+ * producers are done.
+ */
+template <typename Push, typename Pop>
+static double measure_queue(int producers, int consumers, int items, Push push, Pop pop){
+    std::vector<std::thread> producer_threads;
+    std::vector<std::thread> consumer_threads;
+    double start_us = stats_now_us();
+    for (int t = 0; t < consumers; t++){
+        consumer_threads.push_back(std::thread([&pop]{
+            while (pop() != 0)
+                ;
+        }));
+    }
+    for (int t = 0; t < producers; t++){
+        int count = items / producers + (t < items % producers ? 1 : 0);
+        producer_threads.push_back(std::thread([count, &push]{
+            for (int i = 0; i < count; i++)
+                push(i + 1);
+        }));
+    }
+    for (std::thread &thread : producer_threads)
+        thread.join();
+    for (int t = 0; t < consumers; t++)
+        push(0);
+    for (std::thread &thread : consumer_threads)
+        thread.join();
+    return items / ((stats_now_us() - start_us) / 1e6);
+}
+
+/**
+ * One thread pushing and popping in turn: the cost of an uncontended push and pop.
+ */
+template <typename Push, typename Pop>
+static double measure_single_thread(int items, Push push, Pop pop){
+    double start_us = stats_now_us();
+    for (int i = 0; i < items; i++){
+        push(i + 1);
+        pop();
+    }
+    return items / ((stats_now_us() - start_us) / 1e6);
+}
+
+void run_queue_benchmark(int max_threads, int items){
+    printf("Queue benchmark: %d items, Mitems/s\n", items);
+    printf("%8s %12s %12s %12s\n", "threads", "mpmc_ring", "sync_queue", "fifo_queue");
+    for (int threads = 1; threads <= max_threads; threads *= 2){
+        mpmc_ring<int> ring(BENCHMARK_QUEUE_CAPACITY);
+        sync_queue<int> locked_queue(BENCHMARK_QUEUE_CAPACITY);
+        MX::Utils::fifo_queue<int> fifo;
+
+        auto ring_push = [&ring](int item){ ring.push(item, 0); };
+        auto ring_pop = [&ring]{
+            int item;
+            ring.pop(item, 0);
+            return item;
+        };
+        auto locked_push = [&locked_queue](int item){ locked_queue.push(item); };
+        auto locked_pop = [&locked_queue]{ return locked_queue.pop().value(); };
+        auto fifo_push = [&fifo](int item){ fifo.push(item); };
+        // fifo_queue cannot wait for an item, its consumer polls
+        auto fifo_pop = [&fifo]{
+            while (fifo.size() == 0)
+                std::this_thread::yield();
+            return fifo.pop();
+        };
+
+        double ring_rate, locked_rate, fifo_rate;
+        if (threads == 1){
+            ring_rate = measure_single_thread(items, ring_push, ring_pop);
+            locked_rate = measure_single_thread(items, locked_push, locked_pop);
+            fifo_rate = measure_single_thread(items, fifo_push, fifo_pop);
+        } else {
+            int producers = threads / 2;
+            int consumers = threads - producers;
+            ring_rate = measure_queue(producers, consumers, items, ring_push, ring_pop);
+            locked_rate = measure_queue(producers, consumers, items, locked_push, locked_pop);
+            fifo_rate = measure_queue(threads - 1, 1, items, fifo_push, fifo_pop);
+        }
+        printf("%8d %12.2f %12.2f %12.2f\n", threads, ring_rate / 1e6, locked_rate / 1e6, fifo_rate / 1e6);
+    }
+}
@@ -0,0 +1,75 @@
+#include "runtime_results.hpp"
+#include "runtime_utils.hpp"
+#include "runtime_ring.hpp"
+
+#include <stdio.h>
+#include <atomic>
+
+// The state of a slot is twice its generation, plus 1 while it is taken. Each release moves to the next generation,
+// so that a stale view of a slot taken again since cannot release it.
+typedef struct alignas(CACHE_LINE_SIZE) result_slot {
+    std::atomic<unsigned> state;
+    tensors_struct tensors;
+} result_slot;
+
+static result_slot *slots = NULL;
+static int num_slots = 0;
+static std::atomic<unsigned> next_slot(0);
+
+int results_allocate(io_info *info, int count){
+    if (slots != NULL){
+        printf("Error: the result slots are already allocated\n");
+        return 1;
+    }
+    if (count <= 0)
+        return 0;
+    slots = new result_slot[count];
+    for (int i = 0; i < count; i++){
+        slots[i].state = 0;
+        allocate_output_tensors(&slots[i].tensors, info);
+    }
+    num_slots = count;
+    next_slot = 0;
+    return 0;
+}
+
+void results_free(){
+    for (int i = 0; i < num_slots; i++)
+        free_tensors_struct(&slots[i].tensors);
+    delete[] slots;
+    slots = NULL;
+    num_slots = 0;
+}
+
+int results_acquire(unsigned *generation){
+    // Start after the last slot taken, so that the slots are reused in turn and the oldest released one comes first
+    unsigned start = next_slot.load(std::memory_order_relaxed);
+    for (int i = 0; i < num_slots; i++){
+        int slot = (start + i) % num_slots;
+        unsigned state = slots[slot].state.load(std::memory_order_relaxed);
+        if ((state & 1) == 0 &&
+            slots[slot].state.compare_exchange_strong(state, state + 1, std::memory_order_acquire)){
+            next_slot.store(slot + 1, std::memory_order_relaxed);
+            *generation = state >> 1;
+            return slot;
+        }
+    }
+    return -1;
+}
+
+tensors_struct *results_tensors(int slot){
+    return &slots[slot].tensors;
+}
+
+int results_release(int slot, unsigned generation){
+    if (slot < 0 || slot >= num_slots){
+        printf("Error: there is no result slot %d\n", slot);
+        return 1;
+    }
+    unsigned expected = generation * 2 + 1;
+    if (!slots[slot].state.compare_exchange_strong(expected, expected + 1, std::memory_order_release)){
+        printf("Error: the result slot %d is not taken by this view\n", slot);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,757 @@
+#include "runtime_scheduler.hpp"
+#include "runtime_device.hpp"
+#include "runtime_threads.hpp"
+#include "runtime_ring.hpp"
+
+#include <stdio.h>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+static std::atomic_bool started(false);
+static std::atomic_bool batching(false);
+static bool pipelined = false;
+static size_t max_batch = 1;
+static double max_delay_us = 0;
+// Two batches in flight: one being received while the next one is sent, changed by the adaptive controller
+static std::atomic<size_t> in_flight_limit(2);
+static runtime_stats *scheduler_stats = NULL;
+
+// Low-latency mode: the waits for the next request, for the next output and for the completion busy-poll first
+static double spin_us = 0;
+static int realtime_priority = 0;
+static cpu_set_t scheduler_cpus;
+static cpu_set_t conversion_cpus;
+static cpu_set_t pipeline_cpus;
+static int numa_node = -1;
+
+// Moving average of the time the accelerator takes per frame: from the later of the send and the previous output,
+// to the output. It is written by one thread at a time: the caller holding the gate, or the completion thread.
+#define ESTIMATE_WEIGHT 0.125
+static std::atomic<double> frame_service_us(0);
+static double last_output_us = 0;
+
+// Number of requests allowed to wait for the accelerator, 0 for no limit
+static size_t max_depth = 0;
+
+// Protects the gate, and the callers blocked before entering the queue
+static std::mutex queue_mutex;
+// Requests blocked before entering the queue, or waiting for the gate, so that they can be cancelled
+static std::vector<inference_request *> waiting;
+
+// Direct path: one frame at a time on the accelerator, the waiting callers are let through by priority class
+static std::condition_variable gate_cv;
+static bool gate_busy = false;
+static size_t gate_waiting[NUM_INFERENCE_PRIORITIES];
+
+// Batcher: the callers hand their requests to the thread forming the batches through a lock-free ring, and only that
+// thread sorts them by priority class in `pending`. A request leaves the queue through its `state`: taken in a batch
+// by that thread, or abandoned by a timeout or a cancellation, whichever comes first.
+#define REQUEST_QUEUED 0
+#define REQUEST_TAKEN 1
+#define SUBMISSION_RING_CAPACITY 4096
+static mpmc_ring<inference_request *> submission_ring(SUBMISSION_RING_CAPACITY);
+static std::deque<inference_request *> pending[NUM_INFERENCE_PRIORITIES];
+// Requests submitted and not taken yet, in total and per priority class
+static std::atomic<size_t> num_pending(0);
+static std::atomic<size_t> num_queued[NUM_INFERENCE_PRIORITIES];
+// Abandoned requests the batching thread has not dropped yet, transiently negative
+static std::atomic<long> num_abandoned(0);
+// Callers between their check of `started` and their push, waited for before the last requests are failed
+static std::atomic<int> num_submitting(0);
+// Callers blocked by max_queue_depth, waiting on room_cv with queue_mutex
+static std::condition_variable room_cv;
+static std::atomic<int> num_blocked(0);
+// Wakes up the thread forming the batches: new requests, abandoned requests, cancellations, room in flight, stop
+static wait_point collector_event;
+
+// Cancellations by tag, served by the thread forming the batches, which alone knows the queued requests
+typedef struct cancel_order {
+    unsigned long long tag;
+    int cancelled;
+    bool done;
+} cancel_order;
+static std::mutex cancel_mutex;
+static std::condition_variable cancel_cv;
+static std::vector<cancel_order *> cancel_orders;
+static std::atomic<bool> cancel_posted(false);
+static bool collector_running = false;
+
+// Batcher: requests taken from the queue and not output yet, and those of them sent to the accelerator
+static std::atomic<size_t> num_in_flight(0);
+static std::atomic<size_t> num_sent(0);
+
+// Batcher stages, each one handing the requests to the next one in order, a NULL request stops the next stage:
+// input conversion (pipeline only), send, receive, and output conversion (pipeline only)
+#define STAGE_RING_CAPACITY 1024
+static spsc_ring<inference_request *> converted_ring(STAGE_RING_CAPACITY);
+static spsc_ring<inference_request *> sent_ring(STAGE_RING_CAPACITY);
+static spsc_ring<inference_request *> received_ring(STAGE_RING_CAPACITY);
+
+static std::thread convert_thread;
+static std::thread submit_thread;
+static std::thread complete_thread;
+static std::thread finish_thread;
+
+static void complete_request(inference_request *request, int status){
+    std::lock_guard<std::mutex> lock(request->mutex);
+    request->status = status;
+    request->done = true;
+    request->cv.notify_one();
+}
+
+static void update_estimates(inference_request *request){
+    double now_us = stats_now_us();
+    double service_us = now_us - std::max(request->send_us, last_output_us);
+    double average_us = frame_service_us.load(std::memory_order_relaxed);
+    frame_service_us.store(average_us > 0 ? average_us + ESTIMATE_WEIGHT * (service_us - average_us) : service_us,
+                           std::memory_order_relaxed);
+    last_output_us = now_us;
+    stats_record_stage(scheduler_stats, STAGE_DEVICE, now_us - request->send_us);
+    if (request->deadline_us > 0 && now_us > request->deadline_us)
+        stats_record_late(scheduler_stats);
+}
+
+/**
+ * Whether a request with `ahead` frames to be output before its own can still meet its deadline.
+ * Nothing is shed until the accelerator has been measured, and a request finding the accelerator idle is sent
+ * unless its deadline already passed, so that the estimate keeps following the accelerator.
+ */
+static bool can_meet_deadline(inference_request *request, size_t ahead){
+    if (request->deadline_us <= 0)
+        return true;
+    double now_us = stats_now_us();
+    if (now_us >= request->deadline_us)
+        return false;
+    if (ahead == 0)
+        return true;
+    return now_us + (ahead + 1) * frame_service_us.load(std::memory_order_relaxed) <= request->deadline_us;
+}
+
+/**
+ * Wait on `cv` until `ready` holds, the request is cancelled, or its timeout expires.
+ * Returns 0 when ready, and the status of the request otherwise.
+ */
+template <typename Ready>
+static int wait_queued(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, inference_request *request, Ready ready){
+    waiting.push_back(request);
+    int status = 0;
+    while (!ready()){
+        if (request->cancelled){
+            status = RUNTIME_STATUS_CANCELLED;
+            break;
+        }
+        if (!started){
+            printf("Error: the host-side queue is stopped\n");
+            status = RUNTIME_STATUS_NOT_READY;
+            break;
+        }
+        if (request->timeout_us <= 0){
+            cv.wait(lock);
+            continue;
+        }
+        double now_us = stats_now_us();
+        if (now_us >= request->timeout_us){
+            status = RUNTIME_STATUS_TIMEOUT;
+            break;
+        }
+        cv.wait_for(lock, std::chrono::duration<double, std::micro>(request->timeout_us - now_us));
+    }
+    waiting.erase(std::find(waiting.begin(), waiting.end(), request));
+    return status;
+}
+
+static size_t num_gate_waiting(){
+    size_t total = 0;
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++)
+        total += gate_waiting[p];
+    return total;
+}
+
+static bool gate_can_enter(int priority){
+    if (gate_busy)
+        return false;
+    for (int p = 0; p < priority; p++){
+        if (gate_waiting[p] > 0)
+            return false;
+    }
+    return true;
+}
+
+static int direct_submit(inference_request *request){
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        size_t ahead = gate_busy ? 1 : 0;
+        for (int p = 0; p <= request->priority; p++)
+            ahead += gate_waiting[p];
+        if (!can_meet_deadline(request, ahead)){
+            stats_record_shed(scheduler_stats, false);
+            return RUNTIME_STATUS_DEADLINE_MISSED;
+        }
+        bool full = max_depth > 0 && num_gate_waiting() >= max_depth;
+        if (full && request->try_submit)
+            return RUNTIME_STATUS_QUEUE_FULL;
+        int status = wait_queued(gate_cv, lock, request, []{ return max_depth == 0 || num_gate_waiting() < max_depth; });
+        if (status == 0){
+            gate_waiting[request->priority]++;
+            status = wait_queued(gate_cv, lock, request, [request]{ return gate_can_enter(request->priority); });
+            gate_waiting[request->priority]--;
+        }
+        if (status != 0){
+            // Leaving the queue may let a lower class through, or make room
+            gate_cv.notify_all();
+            return status;
+        }
+        gate_busy = true;
+    }
+    request->send_us = stats_now_us();
+    stats_record_queue_wait(scheduler_stats, request->priority, request->send_us - request->enqueue_us);
+
+    int status;
+    if (!can_meet_deadline(request, 0)){
+        stats_record_shed(scheduler_stats, true);
+        status = RUNTIME_STATUS_DEADLINE_MISSED;
+    } else {
+        status = device_send(*request->input_data);
+        if (status == 0)
+            status = device_receive(*request->output_data);
+        if (status == 0)
+            update_estimates(request);
+        else
+            status = RUNTIME_STATUS_DEVICE_ERROR;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        gate_busy = false;
+    }
+    gate_cv.notify_all();
+    return status;
+}
+
+/**
+ * Count one more request in the queue, unless `max_queue_depth` requests already wait.
+ */
+static bool reserve_slot(){
+    size_t count = num_pending.load();
+    do {
+        if (max_depth > 0 && count >= max_depth)
+            return false;
+    } while (!num_pending.compare_exchange_weak(count, count + 1));
+    return true;
+}
+
+// The functions below up to collect_batch run on the thread forming the batches only
+
+static void release_slot(inference_request *request){
+    num_queued[request->priority]--;
+    num_pending--;
+    // Pairs with the increment of num_blocked before a caller checks for room
+    if (num_blocked > 0){
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        room_cv.notify_all();
+    }
+}
+
+static void drop_abandoned(inference_request *request, int status){
+    release_slot(request);
+    num_abandoned--;
+    complete_request(request, status);
+}
+
+static void drain_submissions(){
+    inference_request *request;
+    while (submission_ring.try_pop(request))
+        pending[request->priority].push_back(request);
+}
+
+static void sweep_abandoned(){
+    if (num_abandoned <= 0)
+        return;
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        std::deque<inference_request *>::iterator it = pending[p].begin();
+        while (it != pending[p].end()){
+            int state = (*it)->state;
+            if (state == REQUEST_QUEUED){
+                ++it;
+                continue;
+            }
+            inference_request *request = *it;
+            it = pending[p].erase(it);
+            drop_abandoned(request, state);
+        }
+    }
+}
+
+static void serve_cancel_orders(){
+    if (!cancel_posted)
+        return;
+    std::lock_guard<std::mutex> lock(cancel_mutex);
+    cancel_posted = false;
+    for (cancel_order *order : cancel_orders){
+        for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+            std::deque<inference_request *>::iterator it = pending[p].begin();
+            while (it != pending[p].end()){
+                inference_request *request = *it;
+                int expected = REQUEST_QUEUED;
+                // The abandoned requests are left to sweep_abandoned
+                if (request->tag != order->tag ||
+                    !request->state.compare_exchange_strong(expected, RUNTIME_STATUS_CANCELLED)){
+                    ++it;
+                    continue;
+                }
+                it = pending[p].erase(it);
+                release_slot(request);
+                complete_request(request, RUNTIME_STATUS_CANCELLED);
+                order->cancelled++;
+            }
+        }
+        order->done = true;
+    }
+    cancel_orders.clear();
+    cancel_cv.notify_all();
+}
+
+static bool collector_has_work(){
+    return !started || submission_ring.size() > 0 || num_abandoned > 0 || cancel_posted;
+}
+
+static size_t num_waiting_requests(){
+    size_t total = 0;
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++)
+        total += pending[p].size();
+    return total;
+}
+
+static inference_request *take_pending(){
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        while (!pending[p].empty()){
+            inference_request *request = pending[p].front();
+            pending[p].pop_front();
+            int expected = REQUEST_QUEUED;
+            if (request->state.compare_exchange_strong(expected, REQUEST_TAKEN)){
+                release_slot(request);
+                return request;
+            }
+            drop_abandoned(request, expected);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Time at which the batch must be sent: when the oldest request reaches `max_delay_us`, or earlier if waiting longer
+ * would make a request miss its deadline behind the `ahead` frames in flight.
+ */
+static double batch_send_by_us(size_t ahead){
+    double oldest_us = -1;
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        if (!pending[p].empty() && (oldest_us < 0 || pending[p].front()->enqueue_us < oldest_us))
+            oldest_us = pending[p].front()->enqueue_us;
+    }
+    double send_by_us = oldest_us + max_delay_us;
+    double service_us = frame_service_us.load(std::memory_order_relaxed);
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        for (inference_request *request : pending[p]){
+            if (request->deadline_us > 0)
+                send_by_us = std::min(send_by_us, request->deadline_us - (ahead + 1) * service_us);
+        }
+    }
+    return send_by_us;
+}
+
+/**
+ * Collect the next batch: wait for room in the pipeline, then for `max_batch` requests or until batch_send_by_us.
+ * Returns an empty batch when the batcher is stopped.
+ */
+static void collect_batch(std::vector<inference_request *> &batch){
+    while (true){
+        drain_submissions();
+        sweep_abandoned();
+        serve_cancel_orders();
+        if (!started)
+            return;
+        size_t limit = in_flight_limit;
+        size_t ahead = num_in_flight;
+        if (ahead >= limit){
+            collector_event.wait([]{ return collector_has_work() || num_in_flight < in_flight_limit; }, spin_us);
+            continue;
+        }
+        size_t waiting_requests = num_waiting_requests();
+        if (waiting_requests == 0){
+            collector_event.wait(collector_has_work, spin_us);
+            continue;
+        }
+        size_t batch_size = std::max<size_t>(1, std::min(max_batch, limit - ahead));
+        // Waiting only pays off while the accelerator is busy, an idle one gets the requests right away,
+        // and so do high priority requests
+        if (waiting_requests < batch_size && ahead > 0 && pending[INFERENCE_PRIORITY_HIGH].empty()){
+            double wait_us = batch_send_by_us(ahead) - stats_now_us();
+            if (wait_us > 0){
+                collector_event.wait_for(collector_has_work, spin_us, wait_us);
+                continue;
+            }
+        }
+        while (batch.size() < batch_size){
+            inference_request *request = take_pending();
+            if (request == NULL)
+                break;
+            batch.push_back(request);
+        }
+        if (!batch.empty()){
+            num_in_flight += batch.size();
+            return;
+        }
+    }
+}
+
+static void leave_pipeline(){
+    num_in_flight--;
+    collector_event.notify();
+}
+
+static void configure_stage(const char *name, int stage, const cpu_set_t *default_cpus, int priority){
+    cpu_set_t cpus = *default_cpus;
+    // With pipeline_cpus, each stage gets its own CPU, in order
+    int count = CPU_COUNT(&pipeline_cpus);
+    if (count > 0){
+        int skip = stage % count;
+        CPU_ZERO(&cpus);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if (CPU_ISSET(cpu, &pipeline_cpus) && skip-- == 0){
+                CPU_SET(cpu, &cpus);
+                break;
+            }
+        }
+    }
+    configure_current_thread(name, &cpus, priority);
+    if (numa_node >= 0)
+        prefer_numa_node(numa_node);
+}
+
+static void send_request(inference_request *request){
+    // A stale result only steals the accelerator from the fresher frames behind it
+    if (!can_meet_deadline(request, num_sent)){
+        stats_record_shed(scheduler_stats, true);
+        leave_pipeline();
+        complete_request(request, RUNTIME_STATUS_DEADLINE_MISSED);
+        return;
+    }
+    request->send_us = stats_now_us();
+    if (device_send(*request->input_data) != 0){
+        leave_pipeline();
+        complete_request(request, RUNTIME_STATUS_DEVICE_ERROR);
+        return;
+    }
+    num_sent++;
+    sent_ring.push(request, spin_us);
+}
+
+/**
+ * Fail the requests that were never taken from the queue, and stop the next stage.
+ */
+static void drain_queue(spsc_ring<inference_request *> &next_stage){
+    // A caller may be waiting for room in the ring
+    while (num_submitting > 0){
+        drain_submissions();
+        std::this_thread::yield();
+    }
+    drain_submissions();
+    {
+        std::lock_guard<std::mutex> lock(cancel_mutex);
+        collector_running = false;
+    }
+    serve_cancel_orders();
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        for (inference_request *request : pending[p]){
+            int expected = REQUEST_QUEUED;
+            if (request->state.compare_exchange_strong(expected, REQUEST_TAKEN)){
+                release_slot(request);
+                complete_request(request, RUNTIME_STATUS_NOT_READY);
+            } else {
+                drop_abandoned(request, expected);
+            }
+        }
+        pending[p].clear();
+    }
+    next_stage.push(NULL, 0);
+}
+
+static void submit_loop(){
+    configure_stage("send", 1, &scheduler_cpus, realtime_priority);
+    std::vector<inference_request *> batch;
+    while (started){
+        batch.clear();
+        collect_batch(batch);
+        if (batch.empty())
+            continue;
+
+        double now_us = stats_now_us();
+        stats_record_batch(scheduler_stats, batch.size());
+        for (inference_request *request : batch){
+            stats_record_queue_wait(scheduler_stats, request->priority, now_us - request->enqueue_us);
+            send_request(request);
+        }
+    }
+    drain_queue(sent_ring);
+}
+
+static void convert_loop(){
+    configure_stage("convert", 0, &conversion_cpus, 0);
+    std::vector<inference_request *> batch;
+    while (started){
+        batch.clear();
+        collect_batch(batch);
+        if (batch.empty())
+            continue;
+
+        double now_us = stats_now_us();
+        stats_record_batch(scheduler_stats, batch.size());
+        for (inference_request *request : batch){
+            stats_record_queue_wait(scheduler_stats, request->priority, now_us - request->enqueue_us);
+            int status = request->conversions ? request->conversions->convert_inputs(request->conversions->job) : 0;
+            if (status != 0){
+                leave_pipeline();
+                complete_request(request, status);
+                continue;
+            }
+            converted_ring.push(request, spin_us);
+        }
+    }
+    drain_queue(converted_ring);
+}
+
+static void forward_loop(){
+    configure_stage("send", 1, &scheduler_cpus, realtime_priority);
+    while (true){
+        inference_request *request;
+        converted_ring.pop(request, spin_us);
+        if (request == NULL)
+            break;
+        send_request(request);
+    }
+    sent_ring.push(NULL, 0);
+}
+
+static void complete_loop(){
+    configure_stage("receive", 2, &scheduler_cpus, realtime_priority);
+    // Drain the frames in flight before exiting
+    while (true){
+        inference_request *request;
+        sent_ring.pop(request, spin_us);
+        if (request == NULL)
+            break;
+        int status = device_receive(*request->output_data);
+        if (status == 0)
+            update_estimates(request);
+        else
+            status = RUNTIME_STATUS_DEVICE_ERROR;
+        num_sent--;
+        leave_pipeline();
+        if (status == 0 && request->conversions != NULL)
+            received_ring.push(request, spin_us);
+        else
+            complete_request(request, status);
+    }
+    if (pipelined)
+        received_ring.push(NULL, 0);
+}
+
+static void finish_loop(){
+    configure_stage("finish", 3, &conversion_cpus, 0);
+    while (true){
+        inference_request *request;
+        received_ring.pop(request, spin_us);
+        if (request == NULL)
+            break;
+        complete_request(request, request->conversions->convert_outputs(request->conversions->job));
+    }
+}
+
+int scheduler_start(runtime_config *config, runtime_stats *stats){
+    if (started){
+        printf("Error: the host-side queue is already started\n");
+        return 1;
+    }
+    scheduler_stats = stats;
+    batching = config->dynamic_batching != 0;
+    pipelined = batching && config->pipeline != 0;
+    if (config->pipeline && !batching)
+        printf("Warning: the conversion pipeline needs dynamic_batching, the callers convert their own frames\n");
+    max_batch = config->max_batch_size > 0 ? config->max_batch_size : 1;
+    max_delay_us = config->max_queue_delay_us;
+    in_flight_limit = std::min<size_t>(config->max_in_flight > 0 ? config->max_in_flight : 2 * max_batch,
+                                       STAGE_RING_CAPACITY);
+    max_depth = config->max_queue_depth;
+    spin_us = config->spin_us;
+    realtime_priority = config->realtime_priority;
+    scheduler_cpus = config->scheduler_cpus;
+    conversion_cpus = config->conversion_cpus;
+    pipeline_cpus = config->pipeline_cpus;
+    numa_node = config->numa_node;
+    frame_service_us = 0;
+    last_output_us = 0;
+    started = true;
+    num_in_flight = 0;
+    num_sent = 0;
+    num_abandoned = 0;
+    collector_running = batching;
+    if (pipelined){
+        convert_thread = std::thread(convert_loop);
+        submit_thread = std::thread(forward_loop);
+        complete_thread = std::thread(complete_loop);
+        finish_thread = std::thread(finish_loop);
+    } else if (batching){
+        submit_thread = std::thread(submit_loop);
+        complete_thread = std::thread(complete_loop);
+    }
+    return 0;
+}
+
+static int batched_submit(inference_request *request){
+    size_t ahead = num_in_flight;
+    for (int p = 0; p <= request->priority; p++)
+        ahead += num_queued[p];
+    if (!can_meet_deadline(request, ahead)){
+        stats_record_shed(scheduler_stats, false);
+        return RUNTIME_STATUS_DEADLINE_MISSED;
+    }
+    if (!reserve_slot()){
+        if (request->try_submit)
+            return RUNTIME_STATUS_QUEUE_FULL;
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        num_blocked++;
+        int status = wait_queued(room_cv, lock, request, reserve_slot);
+        num_blocked--;
+        if (status != 0)
+            return status;
+    }
+    num_queued[request->priority]++;
+    request->state = REQUEST_QUEUED;
+    num_submitting++;
+    if (!started){
+        num_submitting--;
+        num_queued[request->priority]--;
+        num_pending--;
+        printf("Error: the host-side queue is stopped\n");
+        return RUNTIME_STATUS_NOT_READY;
+    }
+    submission_ring.push(request, spin_us);
+    num_submitting--;
+    collector_event.notify();
+
+    spin_until([request]{ return request->done.load(); }, spin_us);
+    std::unique_lock<std::mutex> lock(request->mutex);
+    if (request->timeout_us > 0){
+        double now_us = stats_now_us();
+        bool done = now_us < request->timeout_us && request->cv.wait_for(lock,
+            std::chrono::duration<double, std::micro>(request->timeout_us - now_us), [request]{ return request->done.load(); });
+        // Once taken by the batcher, the frame is sent and the outputs must be waited for
+        int expected = REQUEST_QUEUED;
+        if (!done && request->state.compare_exchange_strong(expected, RUNTIME_STATUS_TIMEOUT)){
+            num_abandoned++;
+            collector_event.notify();
+        }
+    }
+    request->cv.wait(lock, [request]{ return request->done.load(); });
+    return request->status;
+}
+
+int scheduler_submit(std::vector<float*> &input_data, std::vector<float*> &output_data,
+                     const request_conversions *conversions, const inference_options *options, double call_us){
+    if (options->priority < 0 || options->priority >= NUM_INFERENCE_PRIORITIES){
+        printf("Error: invalid priority class %d\n", options->priority);
+        return RUNTIME_STATUS_INVALID_ARGUMENT;
+    }
+    inference_request request;
+    request.input_data = &input_data;
+    request.output_data = &output_data;
+    request.priority = options->priority;
+    request.tag = options->tag;
+    request.try_submit = options->try_submit != 0;
+    request.cancelled = false;
+    request.status = RUNTIME_STATUS_OK;
+    request.done = false;
+    request.enqueue_us = stats_now_us();
+    request.deadline_us = options->deadline_us > 0 ? call_us + options->deadline_us : 0;
+    request.timeout_us = options->timeout_us > 0 ? call_us + options->timeout_us : 0;
+    request.send_us = 0;
+    // The pipeline stages convert the frames, otherwise the caller does
+    request.conversions = pipelined ? conversions : NULL;
+    if (!started){
+        printf("Error: the host-side queue is not started\n");
+        return RUNTIME_STATUS_NOT_READY;
+    }
+    if (conversions != NULL && !pipelined){
+        int status = conversions->convert_inputs(conversions->job);
+        if (status != 0)
+            return status;
+    }
+    int status = batching ? batched_submit(&request) : direct_submit(&request);
+    if (status == 0 && conversions != NULL && !pipelined)
+        status = conversions->convert_outputs(conversions->job);
+    if (status == RUNTIME_STATUS_QUEUE_FULL || status == RUNTIME_STATUS_TIMEOUT || status == RUNTIME_STATUS_CANCELLED)
+        stats_record_dropped(scheduler_stats, status);
+    return status;
+}
+
+void scheduler_read_load(scheduler_load *load){
+    load->pending = num_pending;
+    load->in_flight = num_in_flight;
+    load->in_flight_limit = in_flight_limit;
+    load->frame_service_us = frame_service_us.load(std::memory_order_relaxed);
+}
+
+void scheduler_set_in_flight_limit(size_t limit){
+    in_flight_limit = std::max<size_t>(1, std::min<size_t>(limit, STAGE_RING_CAPACITY));
+    collector_event.notify();
+}
+
+int scheduler_cancel(unsigned long long tag){
+    int cancelled = 0;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        for (inference_request *request : waiting){
+            if (request->tag == tag && !request->cancelled){
+                request->cancelled = true;
+                cancelled++;
+            }
+        }
+        if (cancelled > 0){
+            gate_cv.notify_all();
+            room_cv.notify_all();
+        }
+    }
+
+    // The queued requests are cancelled by the thread forming the batches
+    cancel_order order = {tag, 0, false};
+    std::unique_lock<std::mutex> lock(cancel_mutex);
+    if (!collector_running)
+        return cancelled;
+    cancel_orders.push_back(&order);
+    cancel_posted = true;
+    collector_event.notify();
+    cancel_cv.wait(lock, [&order]{ return order.done; });
+    return cancelled + order.cancelled;
+}
+
+void scheduler_stop(){
+    if (!started)
+        return;
+    {
+        std::lock_guard<std::mutex> queue_lock(queue_mutex);
+        started = false;
+    }
+    room_cv.notify_all();
+    gate_cv.notify_all();
+    collector_event.notify();
+    if (pipelined)
+        convert_thread.join();
+    if (batching){
+        submit_thread.join();
+        complete_thread.join();
+    }
+    if (pipelined)
+        finish_thread.join();
+}
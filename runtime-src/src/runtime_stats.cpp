@@ -0,0 +1,214 @@
+#include "runtime_stats.hpp"
+#include <stdio.h>
+
+void reset_runtime_stats(runtime_stats *stats){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->model_loading_us = -1;
+    stats->device = device_settings{0, 0};
+    stats->warmup_iterations = 0;
+    stats->warmup_total_us = 0;
+    stats->first_inference_us = -1;
+    stats->first_request_us = -1;
+    stats->steady_state = latency_summary{0, 0, 0, 0};
+    stats->num_inferences = 0;
+    stats->batch_sizes.clear();
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++)
+        stats->queue_wait[p] = latency_summary{0, 0, 0, 0};
+    for (int s = 0; s < NUM_RUNTIME_STAGES; s++)
+        stats->stages[s] = latency_summary{0, 0, 0, 0};
+    stats->shed_at_admission = 0;
+    stats->shed_in_queue = 0;
+    stats->late_results = 0;
+    stats->queue_full = 0;
+    stats->timeouts = 0;
+    stats->cancelled = 0;
+    stats->in_flight_limit = 0;
+    stats->in_flight_limit_min = 0;
+    stats->in_flight_limit_max = 0;
+    stats->conversion_workers = 0;
+    stats->conversion_workers_min = 0;
+    stats->conversion_workers_max = 0;
+    stats->controller_raises = 0;
+    stats->controller_lowers = 0;
+}
+
+void latency_summary_add(latency_summary *summary, double latency_us){
+    if (summary->count == 0 || latency_us < summary->min_us)
+        summary->min_us = latency_us;
+    if (summary->count == 0 || latency_us > summary->max_us)
+        summary->max_us = latency_us;
+    summary->total_us += latency_us;
+    summary->count++;
+}
+
+void stats_record_model_loading(runtime_stats *stats, double duration_us){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->model_loading_us = duration_us;
+}
+
+void stats_record_device_settings(runtime_stats *stats, device_settings settings){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->device = settings;
+}
+
+static void print_setting(const char *label, int value, bool last){
+    if (value > 0)
+        printf("%s %d%s", label, value, last ? "\n" : ", ");
+    else
+        printf("%s default%s", label, last ? "\n" : ", ");
+}
+
+void stats_record_warmup(runtime_stats *stats, double latency_us){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (stats->first_inference_us < 0)
+        stats->first_inference_us = latency_us;
+    stats->warmup_iterations++;
+    stats->warmup_total_us += latency_us;
+}
+
+void stats_record_inference(runtime_stats *stats, double latency_us){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (stats->first_inference_us < 0)
+        stats->first_inference_us = latency_us;
+    if (stats->first_request_us < 0)
+        stats->first_request_us = latency_us;
+    else
+        latency_summary_add(&stats->steady_state, latency_us);
+    stats->num_inferences++;
+}
+
+void stats_record_batch(runtime_stats *stats, size_t batch_size){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (stats->batch_sizes.size() <= batch_size)
+        stats->batch_sizes.resize(batch_size + 1, 0);
+    stats->batch_sizes[batch_size]++;
+}
+
+void stats_record_queue_wait(runtime_stats *stats, int priority, double wait_us){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    latency_summary_add(&stats->queue_wait[priority], wait_us);
+}
+
+void stats_record_stage(runtime_stats *stats, runtime_stage stage, double duration_us){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    latency_summary_add(&stats->stages[stage], duration_us);
+}
+
+void stats_record_shed(runtime_stats *stats, bool in_queue){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (in_queue)
+        stats->shed_in_queue++;
+    else
+        stats->shed_at_admission++;
+}
+
+void stats_record_late(runtime_stats *stats){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    stats->late_results++;
+}
+
+void stats_record_dropped(runtime_stats *stats, int status){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    switch (status){
+        case RUNTIME_STATUS_QUEUE_FULL:
+            stats->queue_full++;
+            break;
+        case RUNTIME_STATUS_TIMEOUT:
+            stats->timeouts++;
+            break;
+        case RUNTIME_STATUS_CANCELLED:
+            stats->cancelled++;
+            break;
+    }
+}
+
+void stats_record_in_flight_limit(runtime_stats *stats, size_t limit, int direction){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (direction == 0 || limit < stats->in_flight_limit_min)
+        stats->in_flight_limit_min = limit;
+    if (direction == 0 || limit > stats->in_flight_limit_max)
+        stats->in_flight_limit_max = limit;
+    stats->in_flight_limit = limit;
+    if (direction > 0)
+        stats->controller_raises++;
+    else if (direction < 0)
+        stats->controller_lowers++;
+}
+
+void stats_record_conversion_workers(runtime_stats *stats, int count, int direction){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    if (direction == 0 || count < stats->conversion_workers_min)
+        stats->conversion_workers_min = count;
+    if (direction == 0 || count > stats->conversion_workers_max)
+        stats->conversion_workers_max = count;
+    stats->conversion_workers = count;
+    if (direction > 0)
+        stats->controller_raises++;
+    else if (direction < 0)
+        stats->controller_lowers++;
+}
+
+static void print_latency_summary(const char *label, latency_summary *summary){
+    if (summary->count == 0){
+        printf("%s: n/a\n", label);
+        return;
+    }
+    printf("%s: mean %.1f us, min %.1f us, max %.1f us (%zu samples)\n", label,
+           summary->total_us / summary->count, summary->min_us, summary->max_us, summary->count);
+}
+
+void print_runtime_stats(runtime_stats *stats){
+    std::lock_guard<std::mutex> lock(stats->mutex);
+    printf("Runtime statistics:\n");
+    if (stats->model_loading_us >= 0)
+        printf("Model loading: %.1f us\n", stats->model_loading_us);
+    printf("Device settings: ");
+    print_setting("input workers", stats->device.input_workers, false);
+    print_setting("output workers", stats->device.output_workers, true);
+    printf("Inferences: %zu\n", stats->num_inferences);
+    if (stats->warmup_iterations > 0)
+        printf("Warm-up: %zu iterations in %.1f us\n", stats->warmup_iterations, stats->warmup_total_us);
+    if (stats->first_inference_us >= 0)
+        printf("First inference (cold): %.1f us\n", stats->first_inference_us);
+    if (stats->first_request_us >= 0)
+        printf("First request: %.1f us\n", stats->first_request_us);
+    print_latency_summary("Steady state", &stats->steady_state);
+    if (stats->first_inference_us >= 0 && stats->steady_state.count > 0)
+        printf("Cold-start penalty: %.1f us\n",
+               stats->first_inference_us - stats->steady_state.total_us / stats->steady_state.count);
+
+    size_t num_batches = 0;
+    for (size_t count : stats->batch_sizes)
+        num_batches += count;
+    if (num_batches > 0){
+        printf("Batch sizes:");
+        for (size_t size = 1; size < stats->batch_sizes.size(); size++){
+            if (stats->batch_sizes[size] > 0)
+                printf(" %zu: %zu (%.1f%%)", size, stats->batch_sizes[size], 100.0 * stats->batch_sizes[size] / num_batches);
+        }
+        printf("\n");
+    }
+    const char *labels[NUM_INFERENCE_PRIORITIES] = {"Queue wait (high)", "Queue wait (normal)", "Queue wait (low)"};
+    for (int p = 0; p < NUM_INFERENCE_PRIORITIES; p++){
+        if (stats->queue_wait[p].count > 0)
+            print_latency_summary(labels[p], &stats->queue_wait[p]);
+    }
+    const char *stage_labels[NUM_RUNTIME_STAGES] = {"Input conversion", "Device", "Output conversion"};
+    for (int s = 0; s < NUM_RUNTIME_STAGES; s++){
+        if (stats->stages[s].count > 0)
+            print_latency_summary(stage_labels[s], &stats->stages[s]);
+    }
+    if (stats->shed_at_admission + stats->shed_in_queue + stats->late_results > 0)
+        printf("Deadlines: %zu shed at admission, %zu shed in queue, %zu late results\n",
+               stats->shed_at_admission, stats->shed_in_queue, stats->late_results);
+    if (stats->queue_full + stats->timeouts + stats->cancelled > 0)
+        printf("Dropped requests: %zu refused by a full queue, %zu timed out, %zu cancelled\n",
+               stats->queue_full, stats->timeouts, stats->cancelled);
+    if (stats->in_flight_limit > 0)
+        printf("Adaptive controller: %zu frames in flight (%zu to %zu), %zu raises, %zu lowers\n",
+               stats->in_flight_limit, stats->in_flight_limit_min, stats->in_flight_limit_max,
+               stats->controller_raises, stats->controller_lowers);
+    if (stats->conversion_workers_max > 0)
+        printf("Adaptive controller: %d conversion workers (%d to %d)\n", stats->conversion_workers,
+               stats->conversion_workers_min, stats->conversion_workers_max);
+}
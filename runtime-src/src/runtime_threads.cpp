@@ -0,0 +1,131 @@
+#include "runtime_threads.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <atomic>
+
+#define NUMA_NODE_CPULIST_FORMAT "/sys/devices/system/node/node%d/cpulist"
+// Memory policies of set_mempolicy(2), libnuma is not required
+#define MEMORY_POLICY_DEFAULT 0
+#define MEMORY_POLICY_PREFERRED 1
+
+static std::atomic<uint64_t> spin_ns(0);
+
+int parse_cpu_list(const char *value, cpu_set_t *cpus){
+    CPU_ZERO(cpus);
+    if (value == NULL || *value == '\0')
+        return 1;
+    const char *p = value;
+    while (*p != '\0'){
+        char *end = NULL;
+        errno = 0;
+        long first = strtol(p, &end, 10);
+        if (errno != 0 || end == p || first < 0 || first >= CPU_SETSIZE)
+            return 1;
+        long last = first;
+        p = end;
+        if (*p == '-'){
+            p++;
+            last = strtol(p, &end, 10);
+            if (errno != 0 || end == p || last < first || last >= CPU_SETSIZE)
+                return 1;
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, cpus);
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return 1;
+    }
+    return CPU_COUNT(cpus) > 0 ? 0 : 1;
+}
+
+void format_cpu_list(const cpu_set_t *cpus, char *buffer, size_t length){
+    size_t used = 0;
+    buffer[0] = '\0';
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+        if (!CPU_ISSET(cpu, cpus))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus))
+            last++;
+        int written = last > cpu ? snprintf(buffer + used, length - used, "%s%d-%d", used ? "," : "", cpu, last)
+                                 : snprintf(buffer + used, length - used, "%s%d", used ? "," : "", cpu);
+        if (written < 0 || (size_t) written >= length - used)
+            return;
+        used += written;
+        cpu = last;
+    }
+}
+
+void configure_current_thread(const char *name, const cpu_set_t *cpus, int realtime_priority){
+    if (cpus != NULL && CPU_COUNT(cpus) > 0){
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), cpus);
+        if (error != 0)
+            printf("Warning: cannot pin the %s thread: %s\n", name, strerror(error));
+    }
+    if (realtime_priority > 0){
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = realtime_priority;
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0)
+            printf("Warning: cannot give the %s thread the SCHED_FIFO priority %d: %s\n", name, realtime_priority, strerror(error));
+    }
+}
+
+int numa_node_cpus(int node, cpu_set_t *cpus){
+    CPU_ZERO(cpus);
+    char path[128];
+    snprintf(path, sizeof(path), NUMA_NODE_CPULIST_FORMAT, node);
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return 1;
+    char list[1024] = {0};
+    bool found = fgets(list, sizeof(list), fp) != NULL;
+    fclose(fp);
+    if (!found)
+        return 1;
+    list[strcspn(list, "\n")] = '\0';
+    return parse_cpu_list(list, cpus);
+}
+
+void prefer_numa_node(int node){
+    if (node < 0 || node >= MAX_NUMA_NODES){
+        syscall(SYS_set_mempolicy, MEMORY_POLICY_DEFAULT, NULL, 0);
+        return;
+    }
+    unsigned long nodemask[MAX_NUMA_NODES / (8 * sizeof(unsigned long))] = {0};
+    nodemask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_set_mempolicy, MEMORY_POLICY_PREFERRED, nodemask, MAX_NUMA_NODES + 1) != 0)
+        printf("Warning: cannot prefer the memory of the NUMA node %d: %s\n", node, strerror(errno));
+}
+
+void save_thread_placement(thread_placement *placement){
+    placement->has_cpus = sched_getaffinity(0, sizeof(cpu_set_t), &placement->cpus) == 0;
+    memset(placement->nodemask, 0, sizeof(placement->nodemask));
+    placement->has_policy = syscall(SYS_get_mempolicy, &placement->policy, placement->nodemask, MAX_NUMA_NODES,
+                                    NULL, 0) == 0;
+}
+
+void restore_thread_placement(const thread_placement *placement){
+    if (placement->has_cpus)
+        configure_current_thread("calling", &placement->cpus, 0);
+    if (placement->has_policy &&
+        syscall(SYS_set_mempolicy, placement->policy, placement->nodemask, MAX_NUMA_NODES + 1) != 0)
+        printf("Warning: cannot restore the memory policy of the calling thread: %s\n", strerror(errno));
+}
+
+void record_spin_time(double spin_us){
+    spin_ns.fetch_add((uint64_t)(spin_us * 1e3), std::memory_order_relaxed);
+}
+
+double total_spin_us(){
+    return spin_ns.load(std::memory_order_relaxed) / 1e3;
+}
@@ -0,0 +1,305 @@
+#include "runtime_tuner.hpp"
+#include "runtime_device.hpp"
+#include "runtime_scheduler.hpp"
+#include "runtime_stats.hpp"
+#include "runtime_dfp.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <inttypes.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+// Frames of each loading thread not measured, while the pipeline fills up
+#define TUNER_WARMUP_FRAMES 4
+#define TUNER_CACHE_HEADER "# fingerprint host latency_budget_us input_workers output_workers dynamic_batching " \
+                           "max_batch_size max_in_flight throughput p99_us"
+
+typedef struct tuning_candidate {
+    device_settings device;
+    int dynamic_batching;
+    int max_batch_size;
+    int max_in_flight;
+} tuning_candidate;
+
+typedef struct tuning_result {
+    double throughput;
+    double p99_us;
+} tuning_result;
+
+// What a cached entry is valid for
+typedef struct tuning_key {
+    uint64_t fingerprint;
+    char host[HOST_NAME_MAX + 1];
+    int latency_budget_us;
+} tuning_key;
+
+typedef struct load_thread_result {
+    std::vector<double> latencies;
+    double first_us;
+    double last_us;
+    int status;
+} load_thread_result;
+
+static void list_candidates(std::vector<tuning_candidate> &candidates){
+    std::vector<device_settings> devices;
+    const int workers[] = {1, 2};
+    for (int input_workers : workers){
+        for (int output_workers : workers)
+            devices.push_back(device_settings{input_workers, output_workers});
+    }
+    const int batch_sizes[] = {1, 2, 4, 8};
+    // Batches in flight: one leaves the accelerator idle between batches, more hide the transfers but queue longer
+    const int in_flight_batches[] = {1, 2, 4};
+    for (device_settings &device : devices){
+        candidates.push_back(tuning_candidate{device, 0, 1, 0});
+        for (int batch_size : batch_sizes){
+            for (int batches : in_flight_batches)
+                candidates.push_back(tuning_candidate{device, 1, batch_size, batches * batch_size});
+        }
+    }
+}
+
+static void apply_candidate(runtime_config *config, const tuning_candidate *candidate){
+    config->device = candidate->device;
+    config->dynamic_batching = candidate->dynamic_batching;
+    config->max_batch_size = candidate->max_batch_size;
+    config->max_in_flight = candidate->max_in_flight;
+}
+
+static void print_candidate(const tuning_candidate *candidate){
+    const device_settings &device = candidate->device;
+    printf("workers %d/%d", device.input_workers, device.output_workers);
+    if (candidate->dynamic_batching)
+        printf(", batches of %d, %d in flight", candidate->max_batch_size, candidate->max_in_flight);
+    else
+        printf(", no batching");
+}
+
+static void synthetic_load(MX::Types::MxModelInfo *model_info, int iterations, load_thread_result *result){
+    std::vector<std::vector<float>> inputs;
+    std::vector<std::vector<float>> outputs;
+    std::vector<float*> input_data;
+    std::vector<float*> output_data;
+    for (size_t size : model_info->in_featuremap_sizes)
+        inputs.push_back(std::vector<float>(size, 0.0f));
+    for (size_t size : model_info->out_featuremap_sizes)
+        outputs.push_back(std::vector<float>(size, 0.0f));
+    for (std::vector<float> &input : inputs)
+        input_data.push_back(input.data());
+    for (std::vector<float> &output : outputs)
+        output_data.push_back(output.data());
+
+    inference_options options = {INFERENCE_PRIORITY_NORMAL, 0, 0, 0, 0};
+    for (int i = 0; i < TUNER_WARMUP_FRAMES + iterations; i++){
+        double start_us = stats_now_us();
+        if (i == TUNER_WARMUP_FRAMES)
+            result->first_us = start_us;
+        result->status = scheduler_submit(input_data, output_data, NULL, &options, start_us);
+        if (result->status != 0)
+            return;
+        result->last_us = stats_now_us();
+        if (i >= TUNER_WARMUP_FRAMES)
+            result->latencies.push_back(result->last_us - start_us);
+    }
+}
+
+/**
+ * Load the model with a candidate setting, and feed it synthetic frames from `num_threads` threads. Every candidate
+ * gets the same callers, so that the settings are compared under the same load.
+ */
+static int measure_candidate(const char *file_path, const runtime_config *base, const tuning_candidate *candidate,
+                             int num_threads, tuning_result *result){
+    runtime_config config = *base;
+    apply_candidate(&config, candidate);
+    MX::Types::MxModelInfo model_info;
+    if (device_open(file_path, &config, &model_info) != 0 || device_start() != 0){
+        device_close();
+        return 1;
+    }
+    runtime_stats stats;
+    reset_runtime_stats(&stats);
+    if (scheduler_start(&config, &stats) != 0){
+        device_close();
+        return 1;
+    }
+
+    int iterations = std::max(1, base->autotune_iterations / num_threads);
+    std::vector<load_thread_result> thread_results(num_threads, load_thread_result{std::vector<double>(), 0, 0, 0});
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++)
+        threads.push_back(std::thread(synthetic_load, &model_info, iterations, &thread_results[t]));
+    for (std::thread &thread : threads)
+        thread.join();
+    scheduler_stop();
+    device_close();
+
+    std::vector<double> latencies;
+    double first_us = -1;
+    double last_us = 0;
+    for (load_thread_result &thread_result : thread_results){
+        if (thread_result.status != 0)
+            return 1;
+        latencies.insert(latencies.end(), thread_result.latencies.begin(), thread_result.latencies.end());
+        if (first_us < 0 || thread_result.first_us < first_us)
+            first_us = thread_result.first_us;
+        last_us = std::max(last_us, thread_result.last_us);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    result->throughput = latencies.size() / ((last_us - first_us) / 1e6);
+    result->p99_us = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    return 0;
+}
+
+static int read_cached_tuning(const char *cache_path, const tuning_key *key, tuning_candidate *candidate){
+    FILE *fp = fopen(cache_path, "r");
+    if (!fp)
+        return 1;
+    char line[512];
+    int found = 1;
+    while (found != 0 && fgets(line, sizeof(line), fp) != NULL){
+        uint64_t fingerprint;
+        // HOST_NAME_MAX is 64 on Linux
+        char host[65];
+        int budget_us;
+        tuning_candidate entry;
+        device_settings &device = entry.device;
+        int fields = sscanf(line, "%" SCNx64 " %64s %d %d %d %d %d %d", &fingerprint, host, &budget_us,
+                            &device.input_workers, &device.output_workers, &entry.dynamic_batching,
+                            &entry.max_batch_size, &entry.max_in_flight);
+        if (fields == 8 && fingerprint == key->fingerprint && strcmp(host, key->host) == 0 &&
+            budget_us == key->latency_budget_us){
+            *candidate = entry;
+            found = 0;
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+static void write_cached_tuning(const char *cache_path, const tuning_key *key, const tuning_candidate *candidate,
+                                const tuning_result *result){
+    // Keep the entries of the other models and hosts
+    std::vector<std::string> lines;
+    char prefix[512];
+    snprintf(prefix, sizeof(prefix), "%016" PRIx64 " %s %d ", key->fingerprint, key->host, key->latency_budget_us);
+    FILE *fp = fopen(cache_path, "r");
+    if (fp){
+        char line[512];
+        while (fgets(line, sizeof(line), fp) != NULL){
+            if (line[0] != '#' && strncmp(line, prefix, strlen(prefix)) != 0)
+                lines.push_back(line);
+        }
+        fclose(fp);
+    }
+
+    // Replace the cache at once, so that concurrent loads never read a partial file
+    // A file of its own next to the cache, so that concurrent tunings don't write to the same one
+    std::string tmp_path = std::string(cache_path) + ".XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0){
+        printf("Warning: cannot write the auto-tuning cache `%s`\n", cache_path);
+        return;
+    }
+    // mkstemp creates the file for its owner only, the cache is shared
+    fchmod(fd, 0644);
+    fp = fdopen(fd, "w");
+    if (!fp){
+        printf("Warning: cannot write the auto-tuning cache `%s`\n", cache_path);
+        close(fd);
+        remove(tmp_path.c_str());
+        return;
+    }
+    fprintf(fp, "%s\n", TUNER_CACHE_HEADER);
+    for (std::string &line : lines)
+        fputs(line.c_str(), fp);
+    const device_settings &device = candidate->device;
+    fprintf(fp, "%s%d %d %d %d %d %.1f %.1f\n", prefix, device.input_workers, device.output_workers,
+            candidate->dynamic_batching, candidate->max_batch_size, candidate->max_in_flight, result->throughput,
+            result->p99_us);
+    fclose(fp);
+    if (rename(tmp_path.c_str(), cache_path) != 0){
+        printf("Warning: cannot write the auto-tuning cache `%s`\n", cache_path);
+        remove(tmp_path.c_str());
+    }
+}
+
+int tune_runtime(const char *file_path, runtime_config *config){
+    tuning_key key;
+    if (dfp_fingerprint(file_path, &key.fingerprint) != 0)
+        return 1;
+    if (gethostname(key.host, sizeof(key.host)) != 0)
+        strcpy(key.host, "unknown");
+    key.host[HOST_NAME_MAX] = '\0';
+    key.latency_budget_us = config->autotune_latency_budget_us;
+    // The measures of a simulated accelerator say nothing of the device
+    bool cached = config->simulated_device_us == 0;
+
+    tuning_candidate best = {device_settings{0, 0}, 0, 1, 0};
+    if (cached && read_cached_tuning(config->autotune_cache, &key, &best) == 0){
+        printf("Auto-tune: cached settings: ");
+        print_candidate(&best);
+        printf("\n");
+        apply_candidate(config, &best);
+        return 0;
+    }
+
+    std::vector<tuning_candidate> candidates;
+    list_candidates(candidates);
+    // Enough callers to fill the deepest pipeline with a batch still queued behind it
+    int num_threads = 1;
+    for (tuning_candidate &candidate : candidates)
+        num_threads = std::max(num_threads, candidate.max_in_flight + candidate.max_batch_size);
+    tuning_result best_result = {0, 0};
+    bool found = false;
+    bool within_budget = false;
+    for (tuning_candidate &candidate : candidates){
+        tuning_result result;
+        // Measured first, so that the messages of the loading do not cut the line
+        int exit_code = measure_candidate(file_path, config, &candidate, num_threads, &result);
+        printf("Auto-tune: ");
+        print_candidate(&candidate);
+        if (exit_code != 0){
+            printf(": failed\n");
+            continue;
+        }
+        printf(": %.1f inferences/s, p99 %.1f us\n", result.throughput, result.p99_us);
+        bool fits = config->autotune_latency_budget_us == 0 || result.p99_us <= config->autotune_latency_budget_us;
+        // Prefer the settings within the budget, and the lowest latency when none is
+        bool better;
+        if (!found)
+            better = true;
+        else if (fits != within_budget)
+            better = fits;
+        else if (fits)
+            better = result.throughput > best_result.throughput;
+        else
+            better = result.p99_us < best_result.p99_us;
+        if (better){
+            best = candidate;
+            best_result = result;
+            found = true;
+            within_budget = fits;
+        }
+    }
+    if (!found){
+        printf("Error: no setting could be measured\n");
+        return 1;
+    }
+    if (!within_budget)
+        printf("Warning: no setting meets the latency budget of %d us, keeping the one with the lowest p99 latency\n",
+               config->autotune_latency_budget_us);
+    printf("Auto-tune: selected ");
+    print_candidate(&best);
+    printf("\n");
+    if (cached)
+        write_cached_tuning(config->autotune_cache, &key, &best, &best_result);
+    apply_candidate(config, &best);
+    return 0;
+}
@@ -1,4 +1,6 @@
 #include "runtime_utils.hpp"
+#include "runtime_plan.hpp"
+#include "runtime_memory.hpp"
 #include <iostream>
 
 void print_model_info(MX::Types::MxModelInfo &model_info){
@@ -49,40 +51,44 @@ bool input_needs_transpose(int input_index, MX::Types::MxModelInfo &model_info,
     return false;
 }
 
-float *transpose_input_data(int input_index, tensors_struct *input_tensors){
-    // TODO: are these conditions really needed?
-    // Make sure the tensor rank is 4
-    if (input_tensors->ranks[input_index] != 4){
-        printf("Input rank is not 4\n");
-        return NULL;
-    }
+int transpose_input_data_into(int input_index, tensors_struct *input_tensors, float *transposed_data){
     // Make sure the tensor data type is float
     if (input_tensors->data_types[input_index] != DATA_TYPE_FLOAT){
         printf("Input data type is not float\n");
-        return NULL;
-    }
-    // Make sure the batch size is 1
-    if (input_tensors->shapes[input_index][0] != 1){
-        printf("Batch size is not 1\n");
-        return NULL;
-    }
+        return 1;
+    }
+    size_t rank = input_tensors->ranks[input_index];
+    const size_t *shape = input_tensors->shapes[input_index];
+    if (rank > MAX_PLAN_RANK){
+        printf("Input rank is above %d\n", MAX_PLAN_RANK);
+        return 1;
+    }
+    // Any rank and batch, from channel first to the H, W, Z, C layout of the accelerator
+    size_t permutation[MAX_PLAN_RANK];
+    channel_last_permutation(rank, permutation);
+    conversion_plan plan;
+    if (compile_conversion_plan(rank, shape, permutation, &plan) != 0)
+        return 1;
+    // Only axes of one move, the data is the same
+    if (plan.kind == CONVERSION_NONE){
+        memcpy(transposed_data, input_tensors->data[input_index], plan.size);
+        return 0;
+    }
+    return run_conversion_plan(&plan, (const float *)input_tensors->data[input_index], transposed_data);
+}
+
+float *transpose_input_data(int input_index, tensors_struct *input_tensors){
     // Compute tensor size
     size_t size = 1;
     for (size_t i = 0; i < input_tensors->ranks[input_index]; i++)
         size *= input_tensors->shapes[input_index][i];
     // Allocate memory for the transposed data
-    float *transposed_data = (float *)malloc(size * sizeof(float));
-    float *data = (float *)input_tensors->data[input_index];
-    // Move tensor format from NCHW to NHWC
-    size_t C = input_tensors->shapes[input_index][1];
-    size_t H = input_tensors->shapes[input_index][2];
-    size_t W = input_tensors->shapes[input_index][3];
-    for (size_t c = 0; c < C; c++){
-        for (size_t h = 0; h < H; h++){
-            for (size_t w = 0; w < W; w++){
-                transposed_data[h * W * C + w * C + c] = data[c * H * W + h * W + w];
-            }
-        }
+    float *transposed_data = (float *)tensor_alloc(size * sizeof(float));
+    if (transposed_data == NULL)
+        return NULL;
+    if (transpose_input_data_into(input_index, input_tensors, transposed_data) != 0){
+        tensor_free(transposed_data);
+        return NULL;
     }
     return transposed_data;
 }
@@ -108,42 +114,51 @@ bool output_needs_transpose(int output_index, MX::Types::MxModelInfo &model_info
     return false;
 }
 
-float *transpose_output_data(int output_index, tensors_struct *output_tensors){
-    // TODO: are these conditions really needed?
-    // Make sure the tensor rank is 4
-    if (output_tensors->ranks[output_index] != 4){
-        printf("Output rank is not 4\n");
-        return NULL;
-    }
+int transpose_output_data_into(int output_index, tensors_struct *output_tensors, float *transposed_data){
     // Make sure the tensor data type is float
     if (output_tensors->data_types[output_index] != DATA_TYPE_FLOAT){
         printf("Output data type is not float\n");
-        return NULL;
-    }
-    // Make sure the batch size is 1
-    if (output_tensors->shapes[output_index][0] != 1){
-        printf("Batch size is not 1\n");
-        return NULL;
-    }
+        return 1;
+    }
+    size_t rank = output_tensors->ranks[output_index];
+    const size_t *shape = output_tensors->shapes[output_index];
+    if (rank > MAX_PLAN_RANK){
+        printf("Output rank is above %d\n", MAX_PLAN_RANK);
+        return 1;
+    }
+    // Any rank and batch, from the H, W, Z, C layout of the accelerator, the shape permuted, to channel first
+    size_t permutation[MAX_PLAN_RANK];
+    size_t device_shape[MAX_PLAN_RANK];
+    size_t inverse[MAX_PLAN_RANK];
+    channel_last_permutation(rank, permutation);
+    for (size_t d = 0; d < rank; d++){
+        device_shape[d] = shape[permutation[d]];
+        inverse[permutation[d]] = d;
+    }
+    conversion_plan plan;
+    if (compile_conversion_plan(rank, device_shape, inverse, &plan) != 0)
+        return 1;
+    // Only axes of one move, the data is the same
+    if (plan.kind == CONVERSION_NONE){
+        memcpy(transposed_data, output_tensors->data[output_index], plan.size);
+        return 0;
+    }
+    return run_conversion_plan(&plan, (const float *)output_tensors->data[output_index], transposed_data);
+}
+
+float *transpose_output_data(int output_index, tensors_struct *output_tensors){
     // Compute tensor size
     size_t size = 1;
     for (size_t i = 0; i < output_tensors->ranks[output_index]; i++)
         size *= output_tensors->shapes[output_index][i];
     // Allocate memory for the transposed data
-    float *transposed_data = (float *)malloc(size * sizeof(float));
-    float *data = (float *)output_tensors->data[output_index];
-    // Move tensor format from NHWC to NCHW 
-    size_t C = output_tensors->shapes[output_index][1];
-    size_t H = output_tensors->shapes[output_index][2];
-    size_t W = output_tensors->shapes[output_index][3];
-    for (size_t c = 0; c < C; c++){
-        for (size_t h = 0; h < H; h++){
-            for (size_t w = 0; w < W; w++){
-                transposed_data[c * H * W + h * W + w] = data[h * W * C + w * C + c];
-            }
-        }
+    float *transposed_data = (float *)tensor_alloc(size * sizeof(float));
+    if (transposed_data == NULL)
+        return NULL;
+    if (transpose_output_data_into(output_index, output_tensors, transposed_data) != 0){
+        tensor_free(transposed_data);
+        return NULL;
     }
-
     return transposed_data;
 }
 
@@ -157,40 +172,39 @@ void allocate_output_tensors(tensors_struct *output_tensors, io_info *info){
     output_tensors->shapes = (size_t **)malloc(output_tensors->num_tensors * sizeof(size_t *));
     output_tensors->names = (char **)malloc(output_tensors->num_tensors * sizeof(char *));
 
-    // Copy names, data types, ranks, and shapes
-    // Names
-    for (size_t i = 0; i < output_tensors->num_tensors; i++){
-        size_t name_len = strlen(info->output_names[i]);
-        output_tensors->names[i] = (char *)malloc((name_len + 1) * sizeof(char));
-        memcpy(output_tensors->names[i], info->output_names[i], name_len);
-        output_tensors->names[i][name_len] = '\0';
-    }
-    // Data types
-    memcpy(output_tensors->data_types, info->output_datatypes, output_tensors->num_tensors * sizeof(tensor_data_type));
-    // Ranks
-    memcpy(output_tensors->ranks, info->output_ranks, output_tensors->num_tensors * sizeof(size_t));
-    // Shapes
+    // Copy names, data types, ranks, and shapes, and allocate the data
     for (size_t i = 0; i < output_tensors->num_tensors; i++){
-        output_tensors->shapes[i] = (size_t *)malloc(output_tensors->ranks[i] * sizeof(size_t));
-        memcpy(output_tensors->shapes[i], info->output_shapes[i], output_tensors->ranks[i] * sizeof(size_t));
-    }
-    // Compute sizes
-    size_t *sizes = (size_t *)malloc(output_tensors->num_tensors * sizeof(size_t));
-    for (size_t i = 0; i < output_tensors->num_tensors; i++){
-        sizes[i] = 1;
-        for (size_t j = 0; j < output_tensors->ranks[i]; j++){
-            sizes[i] *= output_tensors->shapes[i][j];
-        }
-    }
-    // Allocate memory for data
-    for (size_t i = 0; i < output_tensors->num_tensors; i++){
-        output_tensors->data[i] = malloc(sizes[i] * sizeof(float)); // TODO: support other data types
-        for (size_t j = 0; j < sizes[i]; j++){
+        const tensor_descriptor &output = info->outputs[i];
+        output_tensors->names[i] = strdup(output.name);
+        output_tensors->data_types[i] = output.data_type;
+        output_tensors->ranks[i] = output.rank;
+        output_tensors->shapes[i] = (size_t *)malloc(output.rank * sizeof(size_t));
+        memcpy(output_tensors->shapes[i], output.shape, output.rank * sizeof(size_t));
+        output_tensors->data[i] = tensor_alloc(output.size);
+        for (size_t j = 0; j < output.num_elements; j++){
             ((float *)output_tensors->data[i])[j] = -1.0f;
         }
     }
+}
 
-    free(sizes);
+void allocate_synthetic_input_tensors(tensors_struct *input_tensors, io_info *info){
+    input_tensors->num_tensors = info->num_inputs;
+    input_tensors->data = (void **)malloc(input_tensors->num_tensors * sizeof(void *));
+    input_tensors->data_types = (tensor_data_type *)malloc(input_tensors->num_tensors * sizeof(tensor_data_type));
+    input_tensors->ranks = (size_t *)malloc(input_tensors->num_tensors * sizeof(size_t));
+    input_tensors->shapes = (size_t **)malloc(input_tensors->num_tensors * sizeof(size_t *));
+    input_tensors->names = (char **)malloc(input_tensors->num_tensors * sizeof(char *));
+
+    for (size_t i = 0; i < input_tensors->num_tensors; i++){
+        const tensor_descriptor &input = info->inputs[i];
+        input_tensors->names[i] = strdup(input.name);
+        input_tensors->data_types[i] = DATA_TYPE_FLOAT;
+        input_tensors->ranks[i] = input.rank;
+        input_tensors->shapes[i] = (size_t *)malloc(input.rank * sizeof(size_t));
+        memcpy(input_tensors->shapes[i], input.shape, input.rank * sizeof(size_t));
+        input_tensors->data[i] = tensor_alloc(input.size);
+        memset(input_tensors->data[i], 0, input.size);
+    }
 }
 
 void free_tensors_struct(tensors_struct *tensors) {
@@ -207,8 +221,7 @@ void free_tensors_struct(tensors_struct *tensors) {
 
     if (tensors->data != NULL) {
         for (size_t i = 0; i < tensors->num_tensors; i++) {
-            if (tensors->data[i] != NULL)
-                free(tensors->data[i]);
+            tensor_free(tensors->data[i]);
         }
         free(tensors->data);
         tensors->data = NULL;